@@ -0,0 +1,123 @@
+//
+// Colour conversion time per frame against core count, sliced over a private TaskScheduler of
+// 1, 2, 4, ... workers, on synthetic 1080p, 4K and 8K frames. The output of the run with the most
+// slices is compared against a conversion of the whole frame in one piece.
+//
+// usage: convert_bench [frames per run]
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "SliceConverter.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+};
+
+using namespace std;
+
+namespace {
+
+    using namespace ffmpegUtil;
+
+    AVFrame* allocFrame(AVPixelFormat format, int width, int height) {
+        AVFrame* f = av_frame_alloc();
+        f->format = format;
+        f->width = width;
+        f->height = height;
+        if (av_frame_get_buffer(f, 32) < 0) {
+            av_frame_free(&f);
+            throw std::runtime_error("can not allocate frame.");
+        }
+        return f;
+    }
+
+    // gradients, so that slice seams would show up in the comparison.
+    void fill(AVFrame* f) {
+        int planes = av_pix_fmt_count_planes((AVPixelFormat)f->format);
+        for (int p = 0; p < planes; p++) {
+            int rows = p == 0 ? f->height : AV_CEIL_RSHIFT(f->height,
+                    av_pix_fmt_desc_get((AVPixelFormat)f->format)->log2_chroma_h);
+            for (int y = 0; y < rows; y++) {
+                auto row = (uint16_t*)(f->data[p] + y * f->linesize[p]);
+                for (int x = 0; x < f->linesize[p] / 2; x++) {
+                    row[x] = (uint16_t)(((x + y * 3) * (p + 1)) & 0x3ff);
+                }
+            }
+        }
+    }
+
+    int maxDiff(const AVFrame* a, const AVFrame* b) {
+        int d = 0;
+        int size = av_image_get_buffer_size((AVPixelFormat)a->format, a->width, a->height, 1);
+        vector<uint8_t> bufA(size), bufB(size);
+        av_image_copy_to_buffer(bufA.data(), size, a->data, a->linesize, (AVPixelFormat)a->format, a->width,
+                                a->height, 1);
+        av_image_copy_to_buffer(bufB.data(), size, b->data, b->linesize, (AVPixelFormat)b->format, b->width,
+                                b->height, 1);
+        for (int i = 0; i < size; i++) {
+            d = std::max(d, std::abs(bufA[i] - bufB[i]));
+        }
+        return d;
+    }
+
+    double run(const AVFrame* src, AVFrame* dst, int cores, int frames) {
+        TaskScheduler scheduler{cores};
+        SliceConverter converter{&scheduler};
+        converter.convert(src, dst);
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++) {
+            converter.convert(src, dst);
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+        cout << "cores=" << cores << " slices=" << converter.getSliceCount() << " ms/frame="
+             << elapsed.count() / frames << endl;
+        return elapsed.count() / frames;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int frames = argc > 1 ? std::atoi(argv[1]) : 30;
+    int maxCores = std::max(1, (int)std::thread::hardware_concurrency());
+    av_log_set_level(AV_LOG_ERROR);
+
+    struct Size {
+        const char* name;
+        int width;
+        int height;
+    };
+    for (auto size : {Size{"1080p", 1920, 1080}, Size{"4K", 3840, 2160}, Size{"8K", 7680, 4320}}) {
+        AVFrame* src = allocFrame(AV_PIX_FMT_YUV420P10LE, size.width, size.height);
+        AVFrame* dst = allocFrame(AV_PIX_FMT_YUV420P, size.width, size.height);
+        AVFrame* whole = allocFrame(AV_PIX_FMT_YUV420P, size.width, size.height);
+        fill(src);
+
+        SwsContext* sws = sws_getContext(size.width, size.height, AV_PIX_FMT_YUV420P10LE, size.width, size.height,
+                                         AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+        sws_scale(sws, (uint8_t const* const*)src->data, src->linesize, 0, size.height, whole->data,
+                  whole->linesize);
+        sws_freeContext(sws);
+
+        cout << size.name << " yuv420p10le -> yuv420p, " << frames << " frames per run" << endl;
+        double single = 0;
+        for (int cores = 1; cores <= maxCores; cores *= 2) {
+            double ms = run(src, dst, cores, frames);
+            if (cores == 1) {
+                single = ms;
+            } else {
+                cout << "speedup=" << single / ms << endl;
+            }
+        }
+        cout << "max difference to whole-frame conversion = " << maxDiff(dst, whole) << endl;
+        av_frame_free(&src);
+        av_frame_free(&dst);
+        av_frame_free(&whole);
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+//
+// Demux throughput of PacketGrabber with the default io vs. the mmap and read-ahead AVIOContexts.
+//
+// usage: io_bench <media file> [rounds]
+//
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "ffmpegUtil.h"
+
+using namespace std;
+
+namespace {
+
+    using namespace ffmpegUtil;
+
+    // read syscalls issued by this process so far, linux only.
+    int64_t readSyscalls() {
+        std::ifstream io{"/proc/self/io"};
+        string key;
+        int64_t value;
+        while (io >> key >> value) {
+            if (key == "syscr:") {
+                return value;
+            }
+        }
+        return -1;
+    }
+
+    void demuxAll(const string& inputPath, const InputOptions& options) {
+        int64_t syscallsBefore = readSyscalls();
+        auto begin = std::chrono::steady_clock::now();
+
+        PacketGrabber grabber{inputPath, options};
+        AVPacket* packet = av_packet_alloc();
+        int64_t packets = 0;
+        int64_t bytes = 0;
+        while (grabber.grabPacket(packet) >= 0) {
+            packets++;
+            bytes += packet->size;
+            av_packet_unref(packet);
+        }
+        av_packet_free(&packet);
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+        int64_t syscalls = readSyscalls() - syscallsBefore;
+
+        string name = grabber.isMmapInput() ? "mmap    " : grabber.isPrefetchInput() ? "prefetch" : "default ";
+        cout << name << ": packets=" << packets
+             << " MB=" << bytes / 1e6 << " time=" << elapsed.count() * 1000 << "ms"
+             << " throughput=" << bytes / 1e6 / elapsed.count() << "MB/s"
+             << " read syscalls=" << syscalls << " io stall=" << grabber.getIoStallMs() << "ms" << endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cout << "usage: " << argv[0] << " <media file> [rounds]" << endl;
+        return 1;
+    }
+    string inputPath = argv[1];
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 3;
+
+    av_log_set_level(AV_LOG_ERROR);
+    // first round warms the page cache so all paths read from memory.
+    for (int i = 0; i < rounds; i++) {
+        demuxAll(inputPath, InputOptions::DEFAULT_IO);
+        demuxAll(inputPath, InputOptions::MMAP_IO);
+        demuxAll(inputPath, InputOptions::PREFETCH_IO);
+    }
+    return 0;
+}
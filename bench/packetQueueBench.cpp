@@ -0,0 +1,123 @@
+//
+// Packet queue micro-benchmark: SpscQueue vs. the mutex guarded std::list it replaced.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SpscQueue.hpp"
+
+using namespace std;
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    struct FakePacket {
+        Clock::time_point enqueueTime;
+        int64_t pts = 0;
+    };
+
+    // the old MediaProcessor path: a list node allocation per push and a lock per call.
+    class ListQueue {
+        list<FakePacket*> packetList{};
+        mutex pktListMutex{};
+        const size_t capacity;
+
+    public:
+        explicit ListQueue(size_t c) : capacity(c) {}
+
+        bool tryPush(FakePacket*&& p) {
+            std::lock_guard<std::mutex> lg(pktListMutex);
+            if (packetList.size() >= capacity) {
+                return false;
+            }
+            packetList.push_back(p);
+            return true;
+        }
+
+        bool tryPop(FakePacket*& p) {
+            std::lock_guard<std::mutex> lg(pktListMutex);
+            if (packetList.empty()) {
+                return false;
+            }
+            p = packetList.front();
+            packetList.pop_front();
+            return true;
+        }
+    };
+
+    struct Result {
+        int64_t opsPerSec;
+        int64_t p50Ns;
+        int64_t p99Ns;
+        int64_t p999Ns;
+        int64_t maxNs;
+    };
+
+    template <typename Queue>
+    Result run(Queue& queue, vector<FakePacket>& packets) {
+        const size_t n = packets.size();
+        vector<int64_t> latency(n);
+
+        auto begin = Clock::now();
+        std::thread consumer{[&] {
+            for (size_t i = 0; i < n;) {
+                FakePacket* p = nullptr;
+                if (queue.tryPop(p)) {
+                    latency[i++] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            Clock::now() - p->enqueueTime).count();
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }};
+
+        for (size_t i = 0; i < n; i++) {
+            FakePacket* p = &packets[i];
+            p->enqueueTime = Clock::now();
+            while (!queue.tryPush(std::move(p))) {
+                std::this_thread::yield();
+                p->enqueueTime = Clock::now();
+            }
+        }
+        consumer.join();
+        std::chrono::duration<double> elapsed = Clock::now() - begin;
+
+        std::sort(latency.begin(), latency.end());
+        auto pct = [&](double q) { return latency[std::min(n - 1, (size_t)(q * n))]; };
+        return {(int64_t)(n / elapsed.count()), pct(0.50), pct(0.99), pct(0.999), latency.back()};
+    }
+
+    void print(const string& name, const Result& r) {
+        cout << name << ": " << r.opsPerSec << " ops/s, latency p50=" << r.p50Ns
+             << "ns p99=" << r.p99Ns << "ns p99.9=" << r.p999Ns << "ns max=" << r.maxNs << "ns"
+             << endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    size_t capacity = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 32;
+    cout << "packets=" << count << " capacity=" << capacity << endl;
+
+    vector<FakePacket> packets(count);
+
+    {
+        ListQueue listQueue{capacity};
+        print("std::list + mutex", run(listQueue, packets));
+    }
+
+    {
+        ffmpegUtil::SpscQueue<FakePacket*> spscQueue{capacity};
+        print("SpscQueue        ", run(spscQueue, packets));
+    }
+    return 0;
+}
@@ -0,0 +1,154 @@
+//
+// Throughput of every PixelKernels set this CPU runs against swscale, per conversion, on 4K
+// frames whose source rows are padded so that source and destination strides differ.
+//
+// Each kernel set must match the scalar one exactly and swscale within the dithering error
+// (0 for 8-bit sources, 1 for 10-bit ones); the exit status is 1 if any of them does not.
+//
+// usage: pixel_kernel_bench [frames per run]
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "PixelKernels.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+};
+
+using namespace std;
+
+namespace {
+
+    using namespace ffmpegUtil;
+
+    const int WIDTH = 3840;
+    const int HEIGHT = 2160;
+    const int PADDING = 64;
+
+    AVFrame* allocFrame(AVPixelFormat format, int padding) {
+        AVFrame* f = av_frame_alloc();
+        f->format = format;
+        f->width = WIDTH + padding;
+        f->height = HEIGHT;
+        if (av_frame_get_buffer(f, 32) < 0) {
+            av_frame_free(&f);
+            throw std::runtime_error("can not allocate frame.");
+        }
+        f->width = WIDTH;
+        return f;
+    }
+
+    // random samples in the range of the format: 10 bits in the low or (P010) high bits.
+    void fill(AVFrame* f, std::mt19937& rng) {
+        int planes = av_pix_fmt_count_planes((AVPixelFormat)f->format);
+        for (int p = 0; p < planes; p++) {
+            int rows = p == 0 ? f->height : (f->height + 1) / 2;
+            for (int y = 0; y < rows; y++) {
+                uint8_t* row = f->data[p] + y * f->linesize[p];
+                for (int x = 0; x < f->linesize[p]; x += 2) {
+                    uint16_t v = rng() & 0x3ff;
+                    if (f->format == AV_PIX_FMT_P010LE) {
+                        v <<= 6;
+                    } else if (f->format != AV_PIX_FMT_YUV420P10LE) {
+                        v = rng() & 0xffff;
+                    }
+                    row[x] = (uint8_t)v;
+                    row[x + 1] = (uint8_t)(v >> 8);
+                }
+            }
+        }
+    }
+
+    vector<uint8_t> pack(const AVFrame* f) {
+        int size = av_image_get_buffer_size((AVPixelFormat)f->format, f->width, f->height, 1);
+        vector<uint8_t> buf(size);
+        av_image_copy_to_buffer(buf.data(), size, f->data, f->linesize, (AVPixelFormat)f->format, f->width,
+                                f->height, 1);
+        return buf;
+    }
+
+    int maxDiff(const vector<uint8_t>& a, const vector<uint8_t>& b) {
+        int d = 0;
+        for (size_t i = 0; i < a.size(); i++) {
+            d = std::max(d, std::abs(a[i] - b[i]));
+        }
+        return d;
+    }
+
+    template <typename F>
+    double msPerFrame(int frames, F convert) {
+        convert();
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++) {
+            convert();
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+        return elapsed.count() / frames;
+    }
+
+    void report(const char* name, double ms, double sourceBytes, double baseMs) {
+        cout << "  " << name << ": ms/frame=" << ms << " MB/s=" << sourceBytes / ms / 1000
+             << " vs swscale=" << baseMs / ms << "x" << endl;
+    }
+
+    // @return false if a kernel set disagrees with scalar or swscale.
+    bool run(AVPixelFormat format, int frames, std::mt19937& rng) {
+        AVFrame* src = allocFrame(format, PADDING);
+        AVFrame* dst = allocFrame(AV_PIX_FMT_YUV420P, 0);
+        fill(src, rng);
+        double sourceBytes = av_image_get_buffer_size(format, WIDTH, HEIGHT, 1);
+        int tolerance = format == AV_PIX_FMT_YUV420P10LE || format == AV_PIX_FMT_P010LE ? 1 : 0;
+        cout << av_get_pix_fmt_name(format) << " -> yuv420p " << WIDTH << "x" << HEIGHT << endl;
+
+        SwsContext* sws = sws_getContext(WIDTH, HEIGHT, format, WIDTH, HEIGHT, AV_PIX_FMT_YUV420P, SWS_BILINEAR,
+                                         NULL, NULL, NULL);
+        double swsMs = msPerFrame(frames, [&] {
+            sws_scale(sws, (uint8_t const* const*)src->data, src->linesize, 0, HEIGHT, dst->data, dst->linesize);
+        });
+        sws_freeContext(sws);
+        vector<uint8_t> swsOut = pack(dst);
+        report("swscale", swsMs, sourceBytes, swsMs);
+
+        bool ok = true;
+        vector<uint8_t> scalarOut{};
+        for (auto kernels : PixelKernels::supported()) {
+            double ms = msPerFrame(frames, [&] { PixelKernels::convert(*kernels, src, dst, 0, HEIGHT); });
+            vector<uint8_t> out = pack(dst);
+            if (scalarOut.empty()) {
+                scalarOut = out;
+            }
+            int toScalar = maxDiff(out, scalarOut);
+            int toSws = maxDiff(out, swsOut);
+            report(kernels->name, ms, sourceBytes, swsMs);
+            cout << "    max difference: scalar=" << toScalar << " swscale=" << toSws << endl;
+            if (toScalar != 0 || toSws > tolerance) {
+                cout << "    FAILED" << endl;
+                ok = false;
+            }
+        }
+        av_frame_free(&src);
+        av_frame_free(&dst);
+        return ok;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int frames = argc > 1 ? std::atoi(argv[1]) : 50;
+    av_log_set_level(AV_LOG_ERROR);
+    cout << "kernel set in use: " << PixelKernels::best().name << endl;
+
+    std::mt19937 rng{1};
+    bool ok = true;
+    for (auto format : {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_P010LE}) {
+        ok = run(format, frames, rng) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,482 @@
+//
+// Benchmark suite on synthetic media. Deterministic test files are generated locally with
+// libavcodec encoders (several video codecs, resolutions and audio formats, bitexact, single
+// threaded), then each file goes through:
+//   resample  ReSampler::reSample over all decoded audio, to the playback format and to another rate
+//   convert   SliceConverter on decoded video frames, to YUV420P
+//   queue     the file's packets through the SpscQueue between a reader and a decoder thread
+//   pipeline  a full headless decode with DecodeBenchmark
+//
+// Files are kept in the media directory and only generated when missing.
+//
+// usage: player_bench [media dir] [--regenerate]
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+#include "DecodeBenchmark.h"
+#include "SliceConverter.h"
+#include "SpscQueue.hpp"
+#include "ffmpegUtil.h"
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+};
+
+using namespace std;
+
+namespace {
+
+    using namespace ffmpegUtil;
+    using Clock = std::chrono::steady_clock;
+
+    const int FPS = 30;
+    const int MAX_VIDEO_FRAMES = 16;  // decoded frames kept for the conversion benchmark
+    const int CONVERT_FRAMES = 64;
+    const int RESAMPLE_ROUNDS = 5;
+    const int QUEUE_ROUNDS = 2000;
+
+    struct MediaSpec {
+        const char* name;
+        AVCodecID videoCodec;
+        AVPixelFormat pixelFormat;
+        int width;
+        int height;
+        int64_t videoBitRate;
+        AVCodecID audioCodec;
+        AVSampleFormat sampleFormat;
+        int sampleRate;
+        uint64_t channelLayout;
+        int64_t audioBitRate;
+        int seconds;
+    };
+
+    const vector<MediaSpec>& mediaSet() {
+        static const vector<MediaSpec> set{
+                {"mpeg4_360p_aac_stereo", AV_CODEC_ID_MPEG4, AV_PIX_FMT_YUV420P, 640, 360, 1000000,
+                 AV_CODEC_ID_AAC, AV_SAMPLE_FMT_FLTP, 48000, AV_CH_LAYOUT_STEREO, 128000, 10},
+                {"mpeg4_1080p_mp2_stereo", AV_CODEC_ID_MPEG4, AV_PIX_FMT_YUV420P, 1920, 1080, 8000000,
+                 AV_CODEC_ID_MP2, AV_SAMPLE_FMT_S16, 44100, AV_CH_LAYOUT_STEREO, 192000, 5},
+                {"mjpeg_1080p_pcm_5.1", AV_CODEC_ID_MJPEG, AV_PIX_FMT_YUVJ422P, 1920, 1080, 20000000,
+                 AV_CODEC_ID_PCM_S16LE, AV_SAMPLE_FMT_S16, 48000, AV_CH_LAYOUT_5POINT1, 0, 3},
+                {"ffv1_2160p10_flac_96k", AV_CODEC_ID_FFV1, AV_PIX_FMT_YUV420P10LE, 3840, 2160, 0,
+                 AV_CODEC_ID_FLAC, AV_SAMPLE_FMT_S16, 96000, AV_CH_LAYOUT_STEREO, 0, 2},
+        };
+        return set;
+    }
+
+    double msSince(Clock::time_point begin) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+    }
+
+    // ---------------------------------------------------------------- generation
+
+    struct Output {
+        AVCodecContext* ctx = nullptr;
+        AVStream* stream = nullptr;
+        AVFrame* frame = nullptr;
+        int64_t nextPts = 0;
+
+        ~Output() {
+            av_frame_free(&frame);
+            avcodec_free_context(&ctx);
+        }
+    };
+
+    void openOutput(AVFormatContext* oc, Output& out, AVCodecID id, const std::function<void(AVCodecContext*)>& setup) {
+        AVCodec* codec = avcodec_find_encoder(id);
+        if (codec == nullptr) {
+            throw std::runtime_error(string("no encoder for ") + avcodec_get_name(id));
+        }
+        out.stream = avformat_new_stream(oc, nullptr);
+        out.ctx = avcodec_alloc_context3(codec);
+        setup(out.ctx);
+        out.ctx->thread_count = 1;
+        out.ctx->flags |= AV_CODEC_FLAG_BITEXACT;
+        if (oc->oformat->flags & AVFMT_GLOBALHEADER) {
+            out.ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+        if (avcodec_open2(out.ctx, codec, nullptr) < 0) {
+            throw std::runtime_error(string("can not open encoder ") + avcodec_get_name(id));
+        }
+        avcodec_parameters_from_context(out.stream->codecpar, out.ctx);
+        out.stream->time_base = out.ctx->time_base;
+        out.frame = av_frame_alloc();
+    }
+
+    void encode(AVFormatContext* oc, Output& out, AVFrame* frame, AVPacket* pkt) {
+        if (avcodec_send_frame(out.ctx, frame) < 0) {
+            throw std::runtime_error("avcodec_send_frame failed.");
+        }
+        while (avcodec_receive_packet(out.ctx, pkt) == 0) {
+            av_packet_rescale_ts(pkt, out.ctx->time_base, out.stream->time_base);
+            pkt->stream_index = out.stream->index;
+            if (av_interleaved_write_frame(oc, pkt) < 0) {
+                throw std::runtime_error("av_interleaved_write_frame failed.");
+            }
+        }
+    }
+
+    // a gradient moving right with a bright box moving down, in any planar format up to 16 bits.
+    void fillVideo(AVFrame* f, int64_t index) {
+        if (av_frame_make_writable(f) < 0) {
+            throw std::runtime_error("can not write video frame.");
+        }
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)f->format);
+        for (int c = 0; c < desc->nb_components; c++) {
+            const AVComponentDescriptor& comp = desc->comp[c];
+            bool chroma = c == 1 || c == 2;
+            int w = chroma ? AV_CEIL_RSHIFT(f->width, desc->log2_chroma_w) : f->width;
+            int h = chroma ? AV_CEIL_RSHIFT(f->height, desc->log2_chroma_h) : f->height;
+            int maxValue = (1 << comp.depth) - 1;
+            int boxY = (int)(index * 4 % h);
+            for (int y = 0; y < h; y++) {
+                uint8_t* row = f->data[comp.plane] + y * f->linesize[comp.plane] + comp.offset;
+                for (int x = 0; x < w; x++) {
+                    int v = (int)(((int64_t)(x + index * 8) % w * maxValue / w + (int64_t)y * maxValue / h) / 2);
+                    if (!chroma && y >= boxY && y < boxY + h / 8 && x >= w / 3 && x < w / 2) {
+                        v = maxValue - v / 4;
+                    } else if (chroma) {
+                        v = (v * (c + 1) / 3 + maxValue / 4) & maxValue;
+                    }
+                    if (comp.step == 2) {
+                        row[x * 2] = (uint8_t)v;
+                        row[x * 2 + 1] = (uint8_t)(v >> 8);
+                    } else {
+                        row[x * comp.step] = (uint8_t)v;
+                    }
+                }
+            }
+        }
+    }
+
+    // a different sine tone per channel.
+    void fillAudio(AVFrame* f, int64_t firstSample) {
+        if (av_frame_make_writable(f) < 0) {
+            throw std::runtime_error("can not write audio frame.");
+        }
+        auto format = (AVSampleFormat)f->format;
+        bool planar = av_sample_fmt_is_planar(format);
+        AVSampleFormat packed = av_get_packed_sample_fmt(format);
+        for (int ch = 0; ch < f->channels; ch++) {
+            double step = 2 * M_PI * 220 * (ch + 1) / f->sample_rate;
+            for (int n = 0; n < f->nb_samples; n++) {
+                double s = 0.25 * std::sin(step * (firstSample + n));
+                int i = planar ? n : n * f->channels + ch;
+                uint8_t* data = f->data[planar ? ch : 0];
+                switch (packed) {
+                    case AV_SAMPLE_FMT_S16:
+                        ((int16_t*)data)[i] = (int16_t)(s * 32767);
+                        break;
+                    case AV_SAMPLE_FMT_S32:
+                        ((int32_t*)data)[i] = (int32_t)(s * 2147483647.0);
+                        break;
+                    case AV_SAMPLE_FMT_FLT:
+                        ((float*)data)[i] = (float)s;
+                        break;
+                    default:
+                        throw std::runtime_error("unsupported sample format.");
+                }
+            }
+        }
+    }
+
+    void generate(const MediaSpec& spec, const string& path) {
+        cout << "generating " << path << endl;
+        string partial = path + ".partial";
+        AVFormatContext* oc = nullptr;
+        if (avformat_alloc_output_context2(&oc, nullptr, "matroska", partial.c_str()) < 0) {
+            throw std::runtime_error("can not create muxer for " + partial);
+        }
+        oc->flags |= AVFMT_FLAG_BITEXACT;
+
+        AVPacket* pkt = av_packet_alloc();
+        try {
+            Output video;
+            openOutput(oc, video, spec.videoCodec, [&](AVCodecContext* c) {
+                c->width = spec.width;
+                c->height = spec.height;
+                c->pix_fmt = spec.pixelFormat;
+                c->time_base = AVRational{1, FPS};
+                c->framerate = AVRational{FPS, 1};
+                c->gop_size = FPS;
+                c->max_b_frames = 0;
+                c->bit_rate = spec.videoBitRate;
+            });
+            video.frame->format = spec.pixelFormat;
+            video.frame->width = spec.width;
+            video.frame->height = spec.height;
+            if (av_frame_get_buffer(video.frame, 32) < 0) {
+                throw std::runtime_error("can not allocate video frame.");
+            }
+
+            Output audio;
+            openOutput(oc, audio, spec.audioCodec, [&](AVCodecContext* c) {
+                c->sample_fmt = spec.sampleFormat;
+                c->sample_rate = spec.sampleRate;
+                c->channel_layout = spec.channelLayout;
+                c->channels = av_get_channel_layout_nb_channels(spec.channelLayout);
+                c->time_base = AVRational{1, spec.sampleRate};
+                c->bit_rate = spec.audioBitRate;
+            });
+            audio.frame->format = spec.sampleFormat;
+            audio.frame->channel_layout = spec.channelLayout;
+            audio.frame->channels = audio.ctx->channels;
+            audio.frame->sample_rate = spec.sampleRate;
+            audio.frame->nb_samples = audio.ctx->frame_size > 0 ? audio.ctx->frame_size : 1024;
+            if (av_frame_get_buffer(audio.frame, 0) < 0) {
+                throw std::runtime_error("can not allocate audio frame.");
+            }
+
+            if (avio_open(&oc->pb, partial.c_str(), AVIO_FLAG_WRITE) < 0 || avformat_write_header(oc, nullptr) < 0) {
+                throw std::runtime_error("can not write " + partial);
+            }
+            int64_t videoFrames = (int64_t)spec.seconds * FPS;
+            int64_t audioSamples = (int64_t)spec.seconds * spec.sampleRate;
+            while (video.nextPts < videoFrames || audio.nextPts < audioSamples) {
+                bool videoNext = video.nextPts < videoFrames &&
+                                 (audio.nextPts >= audioSamples ||
+                                  av_compare_ts(video.nextPts, video.ctx->time_base, audio.nextPts,
+                                                audio.ctx->time_base) <= 0);
+                if (videoNext) {
+                    fillVideo(video.frame, video.nextPts);
+                    video.frame->pts = video.nextPts++;
+                    encode(oc, video, video.frame, pkt);
+                } else {
+                    fillAudio(audio.frame, audio.nextPts);
+                    audio.frame->pts = audio.nextPts;
+                    audio.nextPts += audio.frame->nb_samples;
+                    encode(oc, audio, audio.frame, pkt);
+                }
+            }
+            encode(oc, video, nullptr, pkt);
+            encode(oc, audio, nullptr, pkt);
+            av_write_trailer(oc);
+        } catch (std::runtime_error&) {
+            av_packet_free(&pkt);
+            avio_closep(&oc->pb);
+            avformat_free_context(oc);
+            std::remove(partial.c_str());
+            throw;
+        }
+        av_packet_free(&pkt);
+        avio_closep(&oc->pb);
+        avformat_free_context(oc);
+        if (std::rename(partial.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("can not rename " + partial);
+        }
+    }
+
+    bool fileExists(const string& path) {
+        struct stat st{};
+        return stat(path.c_str(), &st) == 0 && st.st_size > 0;
+    }
+
+    // ---------------------------------------------------------------- decoded data
+
+    // everything the stage benchmarks work on, decoded once up front.
+    struct DecodedMedia {
+        vector<AVPacket*> packets{};
+        vector<AVFrame*> audioFrames{};
+        vector<AVFrame*> videoFrames{};
+        AudioInfo audioInfo{};
+        double audioSeconds = 0;
+
+        DecodedMedia() = default;
+        DecodedMedia(const DecodedMedia&) = delete;
+        DecodedMedia operator=(const DecodedMedia&) = delete;
+
+        ~DecodedMedia() {
+            for (auto p : packets) {
+                av_packet_free(&p);
+            }
+            for (auto f : audioFrames) {
+                av_frame_free(&f);
+            }
+            for (auto f : videoFrames) {
+                av_frame_free(&f);
+            }
+        }
+    };
+
+    void receiveAll(AVCodecContext* ctx, vector<AVFrame*>& frames, size_t limit) {
+        while (frames.size() < limit) {
+            AVFrame* frame = av_frame_alloc();
+            if (avcodec_receive_frame(ctx, frame) != 0) {
+                av_frame_free(&frame);
+                return;
+            }
+            frames.push_back(frame);
+        }
+    }
+
+    void decodeAll(const string& path, DecodedMedia& media) {
+        PacketGrabber grabber{path};
+        AVCodecContext* audioCtx = nullptr;
+        AVCodecContext* videoCtx = nullptr;
+        ffUtils::initCodecContext(grabber.getFormatCtx(), grabber.getAudioIndex(), &audioCtx);
+        ffUtils::initCodecContext(grabber.getFormatCtx(), grabber.getVideoIndex(), &videoCtx);
+        media.audioInfo = AudioInfo(audioCtx->channel_layout, audioCtx->sample_rate, audioCtx->channels,
+                                    audioCtx->sample_fmt);
+
+        AVPacket* packet = av_packet_alloc();
+        while (grabber.grabPacket(packet) >= 0) {
+            media.packets.push_back(av_packet_clone(packet));
+            if (packet->stream_index == grabber.getAudioIndex()) {
+                avcodec_send_packet(audioCtx, packet);
+                receiveAll(audioCtx, media.audioFrames, SIZE_MAX);
+            } else if (packet->stream_index == grabber.getVideoIndex() &&
+                       (int)media.videoFrames.size() < MAX_VIDEO_FRAMES) {
+                avcodec_send_packet(videoCtx, packet);
+                receiveAll(videoCtx, media.videoFrames, MAX_VIDEO_FRAMES);
+            }
+            av_packet_unref(packet);
+        }
+        av_packet_free(&packet);
+        avcodec_send_packet(audioCtx, nullptr);
+        receiveAll(audioCtx, media.audioFrames, SIZE_MAX);
+        avcodec_send_packet(videoCtx, nullptr);
+        receiveAll(videoCtx, media.videoFrames, MAX_VIDEO_FRAMES);
+        ffUtils::freeCodecContext(&audioCtx);
+        ffUtils::freeCodecContext(&videoCtx);
+
+        int64_t samples = 0;
+        for (auto f : media.audioFrames) {
+            samples += f->nb_samples;
+        }
+        media.audioSeconds = media.audioInfo.sampleRate > 0 ? (double)samples / media.audioInfo.sampleRate : 0;
+    }
+
+    // ---------------------------------------------------------------- stage benchmarks
+
+    void benchResample(const DecodedMedia& media, const AudioInfo& out, const char* label) {
+        double ms = 0;
+        for (int round = 0; round < RESAMPLE_ROUNDS; round++) {
+            ReSampler reSampler{media.audioInfo, out};
+            auto begin = Clock::now();
+            for (auto f : media.audioFrames) {
+                reSampler.reSample(f);
+            }
+            ms += msSince(begin);
+        }
+        ms /= RESAMPLE_ROUNDS;
+        cout << "  resample " << label << ": " << av_get_sample_fmt_name(media.audioInfo.format) << " "
+             << media.audioInfo.sampleRate << "Hz " << media.audioInfo.channels << "ch -> "
+             << av_get_sample_fmt_name(out.format) << " " << out.sampleRate << "Hz " << out.channels
+             << "ch: ms per audio second=" << (media.audioSeconds > 0 ? ms / media.audioSeconds : 0)
+             << " realtime=" << (ms > 0 ? media.audioSeconds * 1000 / ms : 0) << "x" << endl;
+    }
+
+    void benchConvert(const DecodedMedia& media) {
+        if (media.videoFrames.empty()) {
+            return;
+        }
+        const AVFrame* first = media.videoFrames.front();
+        AVFrame* dst = av_frame_alloc();
+        dst->format = AV_PIX_FMT_YUV420P;
+        dst->width = first->width;
+        dst->height = first->height;
+        if (av_frame_get_buffer(dst, 32) < 0) {
+            av_frame_free(&dst);
+            throw std::runtime_error("can not allocate frame.");
+        }
+        SliceConverter converter{};
+        converter.convert(first, dst);
+        auto begin = Clock::now();
+        for (int i = 0; i < CONVERT_FRAMES; i++) {
+            converter.convert(media.videoFrames[i % media.videoFrames.size()], dst);
+        }
+        double ms = msSince(begin) / CONVERT_FRAMES;
+        cout << "  convert: " << av_get_pix_fmt_name((AVPixelFormat)first->format) << " -> yuv420p "
+             << first->width << "x" << first->height << ": ms/frame=" << ms
+             << " slices=" << converter.getSliceCount() << endl;
+        av_frame_free(&dst);
+    }
+
+    void benchPacketQueue(const DecodedMedia& media) {
+        unique_ptr<SpscQueue<AVPacket*>> queue{new SpscQueue<AVPacket*>(32)};
+        const size_t total = media.packets.size() * QUEUE_ROUNDS;
+        int64_t consumedBytes = 0;
+        auto begin = Clock::now();
+        std::thread producer{[&] {
+            for (int round = 0; round < QUEUE_ROUNDS; round++) {
+                for (auto p : media.packets) {
+                    AVPacket* packet = p;
+                    while (!queue->tryPush(std::move(packet))) {
+                        std::this_thread::yield();
+                    }
+                }
+            }
+        }};
+        for (size_t n = 0; n < total; n++) {
+            AVPacket* packet = nullptr;
+            while (!queue->tryPop(packet)) {
+                std::this_thread::yield();
+            }
+            consumedBytes += packet->size;
+        }
+        producer.join();
+        double ms = msSince(begin);
+        cout << "  queue: " << total << " packets, ns/packet=" << ms * 1e6 / total
+             << " packets/s=" << total / ms * 1000 << " (" << consumedBytes / 1e6 / ms * 1000 << "MB/s)" << endl;
+    }
+
+    void benchPipeline(const string& path) {
+        // YUV420P only: everything else is converted, as playback does for formats SDL can not show.
+        DecodeBenchmarkResult r = DecodeBenchmark::run(path, {AV_PIX_FMT_YUV420P});
+        cout << "  pipeline: fps=" << r.getFps() << " demux MB/s=" << r.getDemuxMBps() << " wall=" << r.wallMs
+             << "ms stage ms: demux=" << r.demuxMs << " decode=" << r.videoDecodeMs + r.audioDecodeMs
+             << " convert=" << r.convertMs << " resample=" << r.resampleMs << endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    string dir = "player-bench-media";
+    bool regenerate = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--regenerate") {
+            regenerate = true;
+        } else {
+            dir = arg;
+        }
+    }
+    av_log_set_level(AV_LOG_ERROR);
+    mkdir(dir.c_str(), 0755);
+
+    int failures = 0;
+    for (const auto& spec : mediaSet()) {
+        string path = dir + "/" + spec.name + ".mkv";
+        try {
+            if (regenerate || !fileExists(path)) {
+                auto begin = Clock::now();
+                generate(spec, path);
+                cout << "generated in " << msSince(begin) << "ms" << endl;
+            }
+            cout << spec.name << endl;
+            DecodedMedia media;
+            decodeAll(path, media);
+            benchResample(media, ReSampler::getDefaultAudioInfo(media.audioInfo.sampleRate), "playback");
+            int otherRate = media.audioInfo.sampleRate == 44100 ? 48000 : 44100;
+            benchResample(media, AudioInfo(AV_CH_LAYOUT_STEREO, otherRate, 2, AV_SAMPLE_FMT_S16), "rate change");
+            benchConvert(media);
+            benchPacketQueue(media);
+            benchPipeline(path);
+        } catch (std::runtime_error& e) {
+            cout << spec.name << " failed: " << e.what() << endl;
+            failures++;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
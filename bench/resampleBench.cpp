@@ -0,0 +1,173 @@
+//
+// Per-frame cost of ReSampler against the way audio used to be resampled: output buffer sized
+// by a 1.2x guess through a runtime sample format switch, cleared before every frame.
+//
+// The input is synthetic (a sine per channel) in the shapes the common decoders produce. The
+// interleaved output of both paths must be identical; the exit status is 1 if it is not.
+//
+// usage: resample_bench [frames per run]
+//
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "ffmpegUtil.h"
+
+using namespace std;
+
+namespace {
+
+    using namespace ffmpegUtil;
+
+    struct Case {
+        const char* name;
+        AVSampleFormat format;
+        int sampleRate;
+        int samples;  // per frame
+        int outRate;
+    };
+
+    // the old ReSampler::allocDataBuf / reSample pair, with the clearing its callers did.
+    class LegacyReSampler {
+        SwrContext* swr;
+        AudioInfo in;
+        AudioInfo out;
+        uint8_t* buffer = nullptr;
+        int bufferSize = 0;
+
+    public:
+        LegacyReSampler(AudioInfo input, AudioInfo output) : in(input), out(output) {
+            swr = swr_alloc_set_opts(nullptr, out.layout, out.format, out.sampleRate, in.layout, in.format,
+                                     in.sampleRate, 0, nullptr);
+            if (swr == nullptr || swr_init(swr)) {
+                throw std::runtime_error("swr_init error.");
+            }
+        }
+
+        ~LegacyReSampler() {
+            av_free(buffer);
+            swr_free(&swr);
+        }
+
+        int reSample(const AVFrame* frame, uint8_t** data) {
+            if (buffer == nullptr) {
+                int bytePerOutSample;
+                switch (out.format) {
+                    case AV_SAMPLE_FMT_U8:
+                        bytePerOutSample = 1;
+                        break;
+                    case AV_SAMPLE_FMT_S32:
+                    case AV_SAMPLE_FMT_FLT:
+                        bytePerOutSample = 4;
+                        break;
+                    default:
+                        bytePerOutSample = 2;
+                        break;
+                }
+                int guess = (int)av_rescale_rnd(frame->nb_samples, out.sampleRate, in.sampleRate, AV_ROUND_UP);
+                bufferSize = (int)(guess * out.channels * bytePerOutSample * 1.2);
+                buffer = (uint8_t*)av_malloc(bufferSize);
+            } else {
+                memset(buffer, 0, bufferSize);
+            }
+            int outSamples = swr_convert(swr, &buffer, bufferSize, (const uint8_t**)&frame->data[0], frame->nb_samples);
+            *data = buffer;
+            return av_samples_get_buffer_size(NULL, out.channels, outSamples, out.format, 1);
+        }
+    };
+
+    AVFrame* makeFrame(const Case& c) {
+        AVFrame* f = av_frame_alloc();
+        f->format = c.format;
+        f->channel_layout = AV_CH_LAYOUT_STEREO;
+        f->channels = 2;
+        f->sample_rate = c.sampleRate;
+        f->nb_samples = c.samples;
+        if (av_frame_get_buffer(f, 0) < 0) {
+            throw std::runtime_error("can not allocate frame.");
+        }
+        for (int i = 0; i < c.samples; i++) {
+            for (int ch = 0; ch < 2; ch++) {
+                double v = 0.5 * std::sin(i * (ch + 1) * 0.05);
+                if (c.format == AV_SAMPLE_FMT_FLTP) {
+                    ((float*)f->data[ch])[i] = (float)v;
+                } else {
+                    ((int16_t*)f->data[0])[i * 2 + ch] = (int16_t)(v * 32767);
+                }
+            }
+        }
+        return f;
+    }
+
+    template <typename F>
+    double nsPerFrame(int frames, F run) {
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++) {
+            run();
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+        return elapsed.count() / frames;
+    }
+
+    // @return false if the two paths produce different output.
+    bool run(const Case& c, int frames) {
+        AVFrame* frame = makeFrame(c);
+        AudioInfo in{AV_CH_LAYOUT_STEREO, c.sampleRate, 2, c.format};
+        cout << c.name << ": " << av_get_sample_fmt_name(c.format) << " " << c.sampleRate << "Hz x" << c.samples
+             << " -> " << c.outRate << "Hz" << endl;
+
+        bool ok = true;
+        {
+            LegacyReSampler legacy{in, ReSampler::getDefaultAudioInfo(c.outRate)};
+            ReSampler reSampler{in, ReSampler::getDefaultAudioInfo(c.outRate)};
+            for (int i = 0; i < 8; i++) {
+                uint8_t* legacyData;
+                int legacySize = legacy.reSample(frame, &legacyData);
+                int size = std::get<1>(reSampler.reSample(frame));
+                if (size != legacySize || memcmp(legacyData, reSampler.getData()[0], size) != 0) {
+                    cout << "  FAILED: output differs from the old path" << endl;
+                    ok = false;
+                    break;
+                }
+            }
+        }
+
+        uint8_t* data;
+        LegacyReSampler legacy{in, ReSampler::getDefaultAudioInfo(c.outRate)};
+        double legacyNs = nsPerFrame(frames, [&] { legacy.reSample(frame, &data); });
+        cout << "  before (guess + clear): ns/frame=" << legacyNs << endl;
+
+        ReSampler reSampler{in, ReSampler::getDefaultAudioInfo(c.outRate)};
+        double ns = nsPerFrame(frames, [&] { reSampler.reSample(frame); });
+        cout << "  ReSampler s16: ns/frame=" << ns << " speedup=" << legacyNs / ns << "x" << endl;
+
+        AVFrame* pcm = av_frame_alloc();
+        ReSampler frameReSampler{in, ReSampler::getDefaultAudioInfo(c.outRate)};
+        ns = nsPerFrame(frames, [&] { frameReSampler.reSample(pcm, frame); });
+        cout << "  ReSampler s16 into frame: ns/frame=" << ns << " speedup=" << legacyNs / ns << "x" << endl;
+        av_frame_free(&pcm);
+
+        FloatPlanarReSampler planar{in, FloatPlanarReSampler::getDefaultAudioInfo(c.outRate)};
+        ns = nsPerFrame(frames, [&] { planar.reSample(frame); });
+        cout << "  FloatPlanarReSampler: ns/frame=" << ns << endl;
+
+        av_frame_free(&frame);
+        return ok;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int frames = argc > 1 ? std::atoi(argv[1]) : 20000;
+    av_log_set_level(AV_LOG_ERROR);
+
+    bool ok = true;
+    for (const Case& c : {Case{"aac", AV_SAMPLE_FMT_FLTP, 44100, 1024, 44100},
+                          Case{"aac rate change", AV_SAMPLE_FMT_FLTP, 44100, 1024, 48000},
+                          Case{"mp2", AV_SAMPLE_FMT_S16, 48000, 1152, 48000}}) {
+        ok = run(c, frames) && ok;
+    }
+    return ok ? 0 : 1;
+}
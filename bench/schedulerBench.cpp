@@ -0,0 +1,124 @@
+//
+// Aggregate video decode throughput of 1, 4 and 16 concurrent streams, decoded on the shared
+// work-stealing TaskScheduler vs. one decode thread per stream.
+//
+// usage: scheduler_bench <media file> [seconds per run]
+//
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ffmpegUtil.h"
+#include "MediaProcessor.hpp"
+
+using namespace std;
+
+namespace {
+
+    using namespace ffmpegUtil;
+
+    struct Stream {
+        PacketGrabber grabber;
+        PacketDemand demand{};
+        unique_ptr<VideoProcessor> video{};
+        std::thread reader{};
+
+        explicit Stream(const string& path) : grabber(path) {}
+    };
+
+    void readVideo(Stream* s) {
+        int videoIndex = s->grabber.getVideoIndex();
+        while (!s->video->isClosing()) {
+            AVPacket* packet = av_packet_alloc();
+            int t = s->grabber.grabPacket(packet);
+            if (t == -1) {
+                av_packet_free(&packet);
+                s->video->pushPkt(nullptr);
+                break;
+            } else if (t == videoIndex) {
+                s->video->pushPkt(unique_ptr<AVPacket>(packet));
+            } else {
+                av_packet_free(&packet);
+            }
+        }
+    }
+
+    double run(const string& inputPath, int streamCount, bool useScheduler, double seconds) {
+        // a private scheduler, so every run starts from idle workers.
+        unique_ptr<TaskScheduler> scheduler{useScheduler ? new TaskScheduler() : nullptr};
+        vector<unique_ptr<Stream>> streams{};
+        for (int i = 0; i < streamCount; i++) {
+            streams.emplace_back(new Stream(inputPath));
+            Stream* s = streams.back().get();
+            s->video.reset(new VideoProcessor(s->grabber.getFormatCtx(), s->grabber.getVideoIndex(),
+                                              DecoderThreading::NONE));
+            s->video->setPacketDemand(&s->demand);
+            s->video->start(scheduler.get());
+            s->reader = std::thread{readVideo, s};
+        }
+
+        // one consumer takes frames as soon as they are ready.
+        int64_t frames = 0;
+        auto begin = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed{};
+        while (elapsed.count() < seconds) {
+            bool progress = false;
+            bool running = false;
+            for (auto& s : streams) {
+                if (s->video->refreshFrame()) {
+                    frames++;
+                    progress = true;
+                }
+                running = running || !s->video->isDrained();
+            }
+            if (!running) {
+                break;
+            }
+            if (!progress) {
+                std::this_thread::yield();
+            }
+            elapsed = std::chrono::steady_clock::now() - begin;
+        }
+
+        double busyMs = 0;
+        uint64_t runs = 0;
+        for (auto& s : streams) {
+            s->video->close();
+            s->demand.notify();
+            s->reader.join();
+            busyMs += s->video->getDecodeStats().getBusyMs();
+            runs += s->video->getDecodeStats().runs.load();
+        }
+        double fps = frames / elapsed.count();
+        cout << (useScheduler ? "scheduler " : "threads   ") << "streams=" << streamCount
+             << " threads=" << (useScheduler ? scheduler->getWorkerCount() : streamCount)
+             << " frames=" << frames << " fps=" << fps
+             << " decode tasks=" << runs << " decode busy=" << busyMs << "ms";
+        if (useScheduler) {
+            cout << " stolen=" << scheduler->getStolen();
+        }
+        cout << endl;
+        return fps;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cout << "usage: " << argv[0] << " <media file> [seconds per run]" << endl;
+        return 1;
+    }
+    string inputPath = argv[1];
+    double seconds = argc > 2 ? std::atof(argv[2]) : 5;
+
+    av_log_set_level(AV_LOG_ERROR);
+    for (int streamCount : {1, 4, 16}) {
+        double threads = run(inputPath, streamCount, false, seconds);
+        double scheduler = run(inputPath, streamCount, true, seconds);
+        cout << "streams=" << streamCount << " scheduler/threads=" << scheduler / threads << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "Instrumentation.h"
+
+namespace ffmpegUtil {
+
+    inline int64_t steadyNanos() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /*
+     * Stream time of the audio being heard, in microseconds.
+     *
+     * The device callback reports the span of stream time it just handed over and when; readers
+     * interpolate from there with the steady clock, minus the device latency (audio handed over
+     * plays after what the device still holds). Interpolation stops at the end of the span, so
+     * an underrun freezes the clock instead of letting it run ahead. With a playback rate other
+     * than 1 (time-stretched audio), stream time advances rate times as fast as the steady clock.
+     *
+     * One writer (the callback, wait-free), any number of readers through a sequence lock.
+     */
+    class AudioClock {
+        std::atomic<uint32_t> sequence{0};
+        std::atomic<int64_t> startUs{-1};
+        std::atomic<int64_t> endUs{-1};
+        std::atomic<int64_t> updateNanos{0};
+        std::atomic<int64_t> latencyUs{0};
+        std::atomic<double> rate{1.0};
+
+    public:
+        AudioClock() = default;
+        AudioClock(const AudioClock&) = delete;
+        AudioClock operator=(const AudioClock&) = delete;
+
+        // device callback: stream time startUs..endUs was handed to the device at nowNanos.
+        void update(int64_t start, int64_t end, int64_t nowNanos = steadyNanos()) {
+            uint32_t s = sequence.load(std::memory_order_relaxed);
+            sequence.store(s + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            startUs.store(start, std::memory_order_relaxed);
+            endUs.store(end, std::memory_order_relaxed);
+            updateNanos.store(nowNanos, std::memory_order_relaxed);
+            sequence.store(s + 2, std::memory_order_release);
+        }
+
+        // what the device buffers between the callback and the speaker.
+        void setLatencyUs(int64_t us) { latencyUs.store(us); }
+
+        int64_t getLatencyUs() const { return latencyUs.load(); }
+
+        // stream seconds played per second of steady clock.
+        void setRate(double r) { rate.store(r); }
+
+        double getRate() const { return rate.load(); }
+
+        // @return -1 before the first update.
+        int64_t getUs(int64_t nowNanos = steadyNanos()) const {
+            int64_t start, end, at;
+            uint32_t before, after;
+            do {
+                before = sequence.load(std::memory_order_acquire);
+                start = startUs.load(std::memory_order_relaxed);
+                end = endUs.load(std::memory_order_relaxed);
+                at = updateNanos.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                after = sequence.load(std::memory_order_relaxed);
+            } while (before != after || (before & 1) != 0);
+            if (start < 0) {
+                return -1;
+            }
+            double r = rate.load(std::memory_order_relaxed);
+            return std::min(start + (int64_t)((nowNanos - at) / 1000 * r), end) -
+                   (int64_t)(latencyUs.load(std::memory_order_relaxed) * r);
+        }
+    };
+
+    /*
+     * Audio-master video pacing. After each presented frame, the delay until the next one is the
+     * frame duration corrected by a fraction of the measured offset, so drift is pulled in over a
+     * few frames instead of through fixed thresholds. The correction is capped at one frame
+     * duration either way; video far behind is caught up by dropping frames, which is the
+     * quality controller's job.
+     *
+     * The offsets measured at presentation are kept as histograms, video ahead and behind
+     * separately.
+     */
+    class AvSync {
+        static constexpr double GAIN = 0.5;
+
+        LatencyHistogram aheadNanos{};
+        LatencyHistogram behindNanos{};
+        std::atomic<uint64_t> withinFrame{0};
+
+    public:
+        AvSync() = default;
+        AvSync(const AvSync&) = delete;
+        AvSync operator=(const AvSync&) = delete;
+
+        /*
+         * Presenting thread: a frame of durationUs was just presented offsetUs ahead of the audio
+         * clock (negative: behind).
+         * @return microseconds to wait before presenting the next frame.
+         */
+        int64_t onPresented(int64_t offsetUs, int64_t durationUs) {
+            uint64_t magnitude = (uint64_t)(offsetUs < 0 ? -offsetUs : offsetUs);
+            (offsetUs < 0 ? behindNanos : aheadNanos).record(magnitude * 1000);
+            if ((int64_t)magnitude <= durationUs) {
+                withinFrame++;
+            }
+            int64_t correction = std::max(-durationUs, std::min(durationUs, (int64_t)(offsetUs * GAIN)));
+            return durationUs + correction;
+        }
+
+        uint64_t getSamples() const { return aheadNanos.getCount() + behindNanos.getCount(); }
+
+        // share of presented frames within one frame duration of the audio clock.
+        double getWithinFrameRatio() const {
+            auto n = getSamples();
+            return n == 0 ? 0 : (double)withinFrame.load() / n;
+        }
+
+        // offsets of frames presented ahead of the audio clock, and of those behind it.
+        const LatencyHistogram& getAhead() const { return aheadNanos; }
+
+        const LatencyHistogram& getBehind() const { return behindNanos; }
+    };
+
+}  // namespace ffmpegUtil
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ffmpegUtil.h"
+#include "MediaProcessor.hpp"
+
+namespace ffmpegUtil {
+
+    using std::cout;
+    using std::endl;
+    using std::string;
+
+    struct DecodeBenchmarkResult {
+        double wallMs = 0;
+        double openMs = 0;
+        uint64_t videoFrames = 0;
+        uint64_t audioFrames = 0;
+        uint64_t packets = 0;
+        uint64_t bytes = 0;
+        double demuxMs = 0;
+        double videoDecodeMs = 0;
+        double audioDecodeMs = 0;
+        double convertMs = 0;
+        double resampleMs = 0;
+        uint64_t convertedFrames = 0;
+        uint64_t passedFrames = 0;
+
+        double getFps() const { return wallMs > 0 ? videoFrames * 1000 / wallMs : 0; }
+
+        double getDemuxMBps() const { return wallMs > 0 ? bytes / 1e3 / wallMs : 0; }
+
+        void print(std::ostream& os) const {
+            os << "benchmark finished in " << wallMs << "ms (open " << openMs << "ms)" << endl;
+            os << "video frames = " << videoFrames << ", fps = " << getFps() << ", audio frames = " << audioFrames
+               << endl;
+            os << "demuxed " << packets << " packets, " << bytes / 1e6 << "MB, " << getDemuxMBps() << "MB/s" << endl;
+            os << "stage time: demux = " << demuxMs << "ms, decode = " << videoDecodeMs + audioDecodeMs
+               << "ms (video " << videoDecodeMs << ", audio " << audioDecodeMs << "), convert = " << convertMs
+               << "ms, resample = " << resampleMs << "ms" << endl;
+        }
+
+        string toJson(const string& file) const {
+            string name = "\"";
+            for (char c : file) {
+                if (c == '"' || c == '\\') {
+                    name += '\\';
+                }
+                name += c;
+            }
+            name += "\"";
+            std::ostringstream os;
+            os << "{\"file\": " << name
+               << ", \"wall_ms\": " << wallMs
+               << ", \"open_ms\": " << openMs
+               << ", \"video_frames\": " << videoFrames
+               << ", \"audio_frames\": " << audioFrames
+               << ", \"fps\": " << getFps()
+               << ", \"demux_packets\": " << packets
+               << ", \"demux_bytes\": " << bytes
+               << ", \"demux_mb_per_s\": " << getDemuxMBps()
+               << ", \"stage_ms\": {\"demux\": " << demuxMs
+               << ", \"decode\": " << videoDecodeMs + audioDecodeMs
+               << ", \"video_decode\": " << videoDecodeMs
+               << ", \"audio_decode\": " << audioDecodeMs
+               << ", \"convert\": " << convertMs
+               << ", \"resample\": " << resampleMs << "}"
+               << ", \"converted_frames\": " << convertedFrames
+               << ", \"passed_frames\": " << passedFrames
+               << "}";
+            return os.str();
+        }
+    };
+
+    /*
+     * Headless decode of a whole file: PacketGrabber -> MediaProcessor as fast as the decoders go,
+     * every decoded frame consumed at once and nothing presented.
+     *
+     * Stage times: demux is the time spent in grabPacket, convert and resample the time the decode
+     * tasks spent in generateNextData, decode the rest of their busy time.
+     */
+    class DecodeBenchmark {
+        struct DemuxStats {
+            std::atomic<uint64_t> packets{0};
+            std::atomic<uint64_t> bytes{0};
+            std::atomic<uint64_t> nanos{0};
+        };
+
+        static bool needPacket(AudioProcessor* audio, VideoProcessor* video) {
+            return (audio != nullptr && audio->needPacket()) || (video != nullptr && video->needPacket());
+        }
+
+        static bool closing(AudioProcessor* audio, VideoProcessor* video) {
+            return (audio != nullptr && audio->isClosing()) || (video != nullptr && video->isClosing());
+        }
+
+        static bool drained(MediaProcessor* processor) {
+            return processor == nullptr || processor->isDrained();
+        }
+
+        static void demuxAll(PacketGrabber& grabber, PacketPool& pool, PacketDemand& demand, AudioProcessor* audio,
+                             VideoProcessor* video, DemuxStats& stats) {
+            Instrumentation::instance().nameThread("reader");
+            while (!closing(audio, video)) {
+                while (needPacket(audio, video)) {
+                    AVPacket* packet = pool.acquire();
+                    auto begin = std::chrono::steady_clock::now();
+                    int t = grabber.grabPacket(packet);
+                    stats.nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - begin).count();
+                    if (t == -1) {
+                        pool.recycle(packet);
+                        if (audio != nullptr) {
+                            audio->pushPkt(nullptr);
+                        }
+                        if (video != nullptr) {
+                            video->pushPkt(nullptr);
+                        }
+                        return;
+                    }
+                    stats.packets++;
+                    stats.bytes += packet->size;
+                    if (audio != nullptr && t == grabber.getAudioIndex()) {
+                        audio->pushPkt(std::unique_ptr<AVPacket>(packet));
+                    } else if (video != nullptr && t == grabber.getVideoIndex()) {
+                        video->pushPkt(std::unique_ptr<AVPacket>(packet));
+                    } else {
+                        pool.recycle(packet);
+                    }
+                }
+                demand.wait([&] { return needPacket(audio, video) || closing(audio, video); });
+            }
+        }
+
+    public:
+        /*
+         * outputFormats: the formats video is handed over in unconverted, see
+         * VideoProcessor::setOutputFormats.
+         */
+        static DecodeBenchmarkResult run(const string& inputPath, const std::vector<AVPixelFormat>& outputFormats) {
+            InputOptions inputOptions{InputOptions::MMAP_IO};
+            inputOptions.fastProbe = true;
+            PacketGrabber packetGrabber{inputPath, inputOptions};
+            auto formatCtx = packetGrabber.getFormatCtx();
+
+            PacketPool packetPool;
+            PacketDemand packetDemand;
+            DemuxStats demuxStats;
+            DecodeBenchmarkResult result{};
+            result.openMs = packetGrabber.getOpenMs();
+
+            auto begin = std::chrono::steady_clock::now();
+            std::unique_ptr<VideoProcessor> video{};
+            if (packetGrabber.getVideoIndex() >= 0) {
+                video.reset(new VideoProcessor(formatCtx, packetGrabber.getVideoIndex()));
+                video->setPacketDemand(&packetDemand);
+                video->setPacketPool(&packetPool);
+                video->setOutputFormats(outputFormats);
+                video->start();
+            }
+            std::unique_ptr<AudioProcessor> audio{};
+            if (packetGrabber.getAudioIndex() >= 0) {
+                audio.reset(new AudioProcessor(formatCtx, packetGrabber.getAudioIndex()));
+                audio->setPacketDemand(&packetDemand);
+                audio->setPacketPool(&packetPool);
+                audio->start();
+            }
+            if (video == nullptr && audio == nullptr) {
+                throw std::runtime_error("no audio or video stream in " + inputPath);
+            }
+
+            std::thread readerThread{demuxAll, std::ref(packetGrabber), std::ref(packetPool),
+                                     std::ref(packetDemand), audio.get(), video.get(), std::ref(demuxStats)};
+
+            while (!drained(video.get()) || !drained(audio.get())) {
+                bool progress = false;
+                while (video != nullptr && video->refreshFrame()) {
+                    result.videoFrames++;
+                    progress = true;
+                }
+                while (audio != nullptr && audio->skipAudioData()) {
+                    result.audioFrames++;
+                    progress = true;
+                }
+                if (!progress) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+            }
+            std::chrono::duration<double, std::milli> wall = std::chrono::steady_clock::now() - begin;
+            result.wallMs = wall.count();
+
+            if (audio != nullptr) {
+                audio->close();
+            }
+            if (video != nullptr) {
+                video->close();
+            }
+            packetDemand.notify();
+            readerThread.join();
+
+            result.packets = demuxStats.packets.load();
+            result.bytes = demuxStats.bytes.load();
+            result.demuxMs = demuxStats.nanos.load() / 1e6;
+            if (video != nullptr) {
+                result.videoDecodeMs = video->getDecodeStats().getBusyMs() - video->getGenerateMs();
+                result.convertMs = video->getGenerateMs();
+                result.convertedFrames = video->getConvertedFrames();
+                result.passedFrames = video->getPassedFrames();
+            }
+            if (audio != nullptr) {
+                result.audioDecodeMs = audio->getDecodeStats().getBusyMs() - audio->getGenerateMs();
+                result.resampleMs = audio->getGenerateMs();
+            }
+            return result;
+        }
+    };
+
+}  // namespace ffmpegUtil
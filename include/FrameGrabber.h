@@ -21,6 +21,7 @@ namespace ffmpegUtil {
 
     const bool videoEnabled;
     const bool audioEnabled;
+    const bool streamInfoCacheEnabled;
 
     int videoIndex = -1;
     int audioIndex = -1;
@@ -28,7 +29,7 @@ namespace ffmpegUtil {
     AVFormatContext* formatCtx = nullptr;
     AVCodecContext* vCodecCtx = nullptr;
     AVCodecContext* aCodecCtx = nullptr;
-    AVPacket* packet = (AVPacket*)av_malloc(sizeof(AVPacket));
+    AVPacket* packet = av_packet_alloc();
     bool fileGotToEnd = false;
 
     /*
@@ -164,8 +165,10 @@ namespace ffmpegUtil {
     };
 
   public:
-    FrameGrabber(const string& uri, bool enableVideo = true, bool enableAudio = true)
-      : inputUrl(uri), videoEnabled(enableVideo), audioEnabled(enableAudio) {
+    FrameGrabber(const string& uri, bool enableVideo = true, bool enableAudio = true,
+                 bool useStreamInfoCache = true)
+      : inputUrl(uri), videoEnabled(enableVideo), audioEnabled(enableAudio),
+        streamInfoCacheEnabled(useStreamInfoCache) {
       formatCtx = avformat_alloc_context();
     }
 
@@ -276,7 +279,7 @@ namespace ffmpegUtil {
         throw std::runtime_error(errorMsg);
       }
 
-      if (avformat_find_stream_info(formatCtx, NULL) < 0) {
+      if (!ffUtils::findStreamInfo(formatCtx, inputUrl, streamInfoCacheEnabled)) {
         string errorMsg = "Can not find stream information in input file:";
         errorMsg += inputUrl;
         cout << errorMsg << endl;
@@ -284,12 +287,12 @@ namespace ffmpegUtil {
       }
 
       for (int i = 0; i < formatCtx->nb_streams; i++) {
-        if (formatCtx->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO && videoIndex == -1) {
+        if (formatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && videoIndex == -1) {
           videoIndex = i;
           cout << "video stream index = : [" << i << "]" << endl;
         }
 
-        if (formatCtx->streams[i]->codec->codec_type == AVMEDIA_TYPE_AUDIO && audioIndex == -1) {
+        if (formatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && audioIndex == -1) {
           audioIndex = i;
           cout << "audio stream index = : [" << i << "]" << endl;
         }
@@ -323,8 +326,6 @@ namespace ffmpegUtil {
       cout << "--------------- File Information ----------------" << endl;
       av_dump_format(formatCtx, videoIndex, inputUrl.c_str(), 0);
       cout << "-------------------------------------------------\n" << endl;
-
-      packet = (AVPacket*)av_malloc(sizeof(AVPacket));
     }
 
     AVCodecContext* getAudioContext() const { return aCodecCtx; }
@@ -465,8 +466,13 @@ namespace ffmpegUtil {
 
     void close() {
 
+      ffUtils::freeCodecContext(&vCodecCtx);
+      ffUtils::freeCodecContext(&aCodecCtx);
+
       avformat_free_context(formatCtx);
 
+      av_packet_free(&packet);
+
     }
   };
 
@@ -0,0 +1,192 @@
+#pragma once
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include "SDL2/SDL.h"
+};
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "Instrumentation.h"
+#include "Logger.h"
+
+namespace ffmpegUtil {
+
+    using std::cout;
+    using std::endl;
+
+    /*
+     * Shows decoded frames through an SDL streaming texture in the frame's own pixel format.
+     *
+     * getDisplayFormats() is what this renderer takes as is: the candidateFormats() the SDL
+     * renderer reports as native texture formats. Producers hand those over untouched and convert
+     * everything else to the first (preferred) one. The texture follows the format and size of
+     * the frames it is given.
+     */
+    class FrameRenderer {
+        SDL_Renderer* renderer;
+        SDL_Texture* texture = nullptr;
+        int textureFormat = AV_PIX_FMT_NONE;
+        int textureWidth = 0;
+        int textureHeight = 0;
+
+        std::vector<AVPixelFormat> displayFormats{};
+
+        uint64_t frames = 0;
+        uint64_t uploadedBytes = 0;
+
+        bool prepareTexture(const AVFrame* f) {
+            if (texture != nullptr && textureFormat == f->format && textureWidth == f->width &&
+                textureHeight == f->height) {
+                return true;
+            }
+            if (texture != nullptr) {
+                SDL_DestroyTexture(texture);
+            }
+            texture = SDL_CreateTexture(renderer, sdlFormat((AVPixelFormat)f->format), SDL_TEXTUREACCESS_STREAMING,
+                                        f->width, f->height);
+            if (texture == nullptr) {
+                cout << "can not create texture: " << SDL_GetError() << endl;
+                return false;
+            }
+            textureFormat = f->format;
+            textureWidth = f->width;
+            textureHeight = f->height;
+            cout << "texture format: " << av_get_pix_fmt_name((AVPixelFormat)f->format) << " " << f->width << "x"
+                 << f->height << endl;
+            return true;
+        }
+
+        // semi-planar formats have no update call in SDL 2.0.10, copy the planes into the locked texture.
+        bool uploadSemiPlanar(const AVFrame* f) {
+            void* pixels = nullptr;
+            int pitch = 0;
+            if (SDL_LockTexture(texture, nullptr, &pixels, &pitch) != 0) {
+                return false;
+            }
+            auto dst = (uint8_t*)pixels;
+            int rowBytes = (f->width + 1) & ~1;
+            for (int y = 0; y < f->height; y++) {
+                std::memcpy(dst + y * pitch, f->data[0] + y * f->linesize[0], f->width);
+            }
+            dst += pitch * f->height;
+            for (int y = 0; y < (f->height + 1) / 2; y++) {
+                std::memcpy(dst + y * pitch, f->data[1] + y * f->linesize[1], rowBytes);
+            }
+            SDL_UnlockTexture(texture);
+            return true;
+        }
+
+    public:
+        FrameRenderer(const FrameRenderer&) = delete;
+        FrameRenderer(FrameRenderer&&) noexcept = delete;
+        FrameRenderer operator=(const FrameRenderer&) = delete;
+
+        explicit FrameRenderer(SDL_Renderer* r) : renderer(r) {
+            SDL_RendererInfo info{};
+            if (SDL_GetRendererInfo(renderer, &info) == 0) {
+                for (auto f : candidateFormats()) {
+                    for (Uint32 i = 0; i < info.num_texture_formats; i++) {
+                        if (sdlFormat(f) == info.texture_formats[i]) {
+                            displayFormats.push_back(f);
+                            break;
+                        }
+                    }
+                }
+            }
+            if (displayFormats.empty()) {
+                // SDL still takes IYUV textures on renderers without them, converting in software.
+                displayFormats.push_back(AV_PIX_FMT_YUV420P);
+            }
+            cout << "renderer " << (info.name != nullptr ? info.name : "?") << " display formats:";
+            for (auto f : displayFormats) {
+                cout << " " << av_get_pix_fmt_name(f);
+            }
+            cout << endl;
+        }
+
+        ~FrameRenderer() {
+            if (texture != nullptr) {
+                SDL_DestroyTexture(texture);
+            }
+        }
+
+        // SDL_PIXELFORMAT_UNKNOWN when SDL has no texture format for f.
+        static Uint32 sdlFormat(AVPixelFormat f) {
+            switch (f) {
+                case AV_PIX_FMT_YUV420P:
+                    return SDL_PIXELFORMAT_IYUV;
+                case AV_PIX_FMT_NV12:
+                    return SDL_PIXELFORMAT_NV12;
+                case AV_PIX_FMT_NV21:
+                    return SDL_PIXELFORMAT_NV21;
+                case AV_PIX_FMT_YUYV422:
+                    return SDL_PIXELFORMAT_YUY2;
+                case AV_PIX_FMT_UYVY422:
+                    return SDL_PIXELFORMAT_UYVY;
+                case AV_PIX_FMT_YVYU422:
+                    return SDL_PIXELFORMAT_YVYU;
+                default:
+                    return SDL_PIXELFORMAT_UNKNOWN;
+            }
+        }
+
+        // formats a renderer may show without conversion, the preferred conversion target first.
+        static std::vector<AVPixelFormat> candidateFormats() {
+            return {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, AV_PIX_FMT_NV21,
+                    AV_PIX_FMT_YUYV422, AV_PIX_FMT_UYVY422, AV_PIX_FMT_YVYU422};
+        }
+
+        // what this renderer shows without conversion, the preferred conversion target first.
+        const std::vector<AVPixelFormat>& getDisplayFormats() const { return displayFormats; }
+
+        bool isDisplayFormat(int f) const {
+            return std::find(displayFormats.begin(), displayFormats.end(), (AVPixelFormat)f) != displayFormats.end();
+        }
+
+        // uploads f and presents it, f must be in one of getDisplayFormats().
+        bool render(const AVFrame* f) {
+            if (!isDisplayFormat(f->format) || !prepareTexture(f)) {
+                return false;
+            }
+            auto& instrumentation = Instrumentation::instance();
+            uint64_t uploadBegin = instrumentation.now();
+            int ret;
+            switch (f->format) {
+                case AV_PIX_FMT_YUV420P:
+                    ret = SDL_UpdateYUVTexture(texture, nullptr, f->data[0], f->linesize[0], f->data[1],
+                                               f->linesize[1], f->data[2], f->linesize[2]);
+                    break;
+                case AV_PIX_FMT_NV12:
+                case AV_PIX_FMT_NV21:
+                    ret = uploadSemiPlanar(f) ? 0 : -1;
+                    break;
+                default:
+                    ret = SDL_UpdateTexture(texture, nullptr, f->data[0], f->linesize[0]);
+                    break;
+            }
+            instrumentation.record(Instrumentation::TEXTURE_UPLOAD, uploadBegin, instrumentation.now());
+            if (ret != 0) {
+                LOG_ERROR("texture upload failed: " << SDL_GetError());
+                return false;
+            }
+            frames++;
+            uploadedBytes += av_image_get_buffer_size((AVPixelFormat)f->format, f->width, f->height, 1);
+
+            StageTimer timer{Instrumentation::PRESENT};
+            SDL_RenderClear(renderer);
+            SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+            SDL_RenderPresent(renderer);
+            return true;
+        }
+
+        uint64_t getFrames() const { return frames; }
+
+        // bytes copied into the texture per frame shown.
+        double getUploadBytesPerFrame() const { return frames == 0 ? 0 : (double)uploadedBytes / frames; }
+    };
+
+}  // namespace ffmpegUtil
@@ -0,0 +1,326 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace ffmpegUtil {
+
+    using std::cout;
+    using std::endl;
+    using std::string;
+
+    /*
+     * Log-linear latency histogram in nanoseconds, HDR style: 32 linear sub-buckets per power of
+     * two, so every recorded value is kept within about 3%. One writer thread, any number of
+     * readers; counts are relaxed atomics, so readers see a consistent-enough snapshot without
+     * locking the writer.
+     */
+    class LatencyHistogram {
+        static const int SUB_BITS = 5;
+        static const int SUB_COUNT = 1 << SUB_BITS;
+        static const int MAX_EXPONENT = 44;  // ~4.8 hours, larger values are clamped
+        static const int BUCKETS = (MAX_EXPONENT - SUB_BITS + 2) * SUB_COUNT;
+
+        std::atomic<uint64_t> counts[BUCKETS];
+        std::atomic<uint64_t> total{0};
+        std::atomic<uint64_t> sumNanos{0};
+        std::atomic<uint64_t> maxNanos{0};
+
+        static int exponentOf(uint64_t v) {
+            int e = 0;
+            while (v >>= 1) {
+                e++;
+            }
+            return e;
+        }
+
+        static int indexOf(uint64_t v) {
+            if (v < SUB_COUNT) {
+                return (int)v;
+            }
+            int e = exponentOf(v);
+            e = e < MAX_EXPONENT ? e : MAX_EXPONENT;
+            int sub = (int)((v >> (e - SUB_BITS)) & (SUB_COUNT - 1));
+            return (e - SUB_BITS + 1) * SUB_COUNT + sub;
+        }
+
+        // middle of the range of values that land in bucket i.
+        static uint64_t valueOf(int i) {
+            if (i < SUB_COUNT) {
+                return (uint64_t)i;
+            }
+            int e = i / SUB_COUNT + SUB_BITS - 1;
+            uint64_t low = (uint64_t)(SUB_COUNT + i % SUB_COUNT) << (e - SUB_BITS);
+            return low + ((uint64_t)1 << (e - SUB_BITS)) / 2;
+        }
+
+    public:
+        LatencyHistogram() {
+            for (auto& c : counts) {
+                c.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        LatencyHistogram(const LatencyHistogram&) = delete;
+        LatencyHistogram operator=(const LatencyHistogram&) = delete;
+
+        // writer thread only.
+        void record(uint64_t nanos) {
+            counts[indexOf(nanos)].fetch_add(1, std::memory_order_relaxed);
+            total.fetch_add(1, std::memory_order_relaxed);
+            sumNanos.fetch_add(nanos, std::memory_order_relaxed);
+            if (nanos > maxNanos.load(std::memory_order_relaxed)) {
+                maxNanos.store(nanos, std::memory_order_relaxed);
+            }
+        }
+
+        void add(const LatencyHistogram& other) {
+            for (int i = 0; i < BUCKETS; i++) {
+                counts[i].fetch_add(other.counts[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+            total.fetch_add(other.getCount(), std::memory_order_relaxed);
+            sumNanos.fetch_add(other.sumNanos.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            maxNanos.store(std::max(getMaxNanos(), other.getMaxNanos()), std::memory_order_relaxed);
+        }
+
+        uint64_t getCount() const { return total.load(std::memory_order_relaxed); }
+
+        uint64_t getMaxNanos() const { return maxNanos.load(std::memory_order_relaxed); }
+
+        double getMeanNanos() const {
+            auto n = getCount();
+            return n == 0 ? 0 : (double)sumNanos.load(std::memory_order_relaxed) / n;
+        }
+
+        // p in [0, 100].
+        uint64_t getPercentileNanos(double p) const {
+            auto n = getCount();
+            if (n == 0) {
+                return 0;
+            }
+            auto rank = std::max<uint64_t>(1, (uint64_t)(p / 100 * n + 0.5));
+            uint64_t seen = 0;
+            for (int i = 0; i < BUCKETS; i++) {
+                seen += counts[i].load(std::memory_order_relaxed);
+                if (seen >= rank) {
+                    return std::min(valueOf(i), getMaxNanos());
+                }
+            }
+            return getMaxNanos();
+        }
+    };
+
+    /*
+     * Hot-path stage timings. Every thread that records gets its own histograms (and, with
+     * tracing on, its own ring of trace events), so recording never takes a lock or allocates;
+     * a thread claims one of MAX_THREADS preallocated slots on its first record or nameThread,
+     * threads past that are not recorded. Histograms are always collected; trace events only
+     * after enableTrace(), and only the last TRACE_EVENTS of each thread are kept.
+     *
+     * Summaries and traces are meant to be written once the recording threads are quiet.
+     */
+    class Instrumentation {
+    public:
+        enum Stage { DEMUX, SEND_PACKET, RECEIVE_FRAME, GENERATE, TEXTURE_UPLOAD, PRESENT, AUDIO_CALLBACK, STAGE_COUNT };
+
+    private:
+        static const size_t TRACE_EVENTS = 1 << 16;
+        static const int MAX_THREADS = 64;
+        static const size_t NAME_SIZE = 32;
+
+        struct TraceEvent {
+            uint64_t beginNanos;
+            uint64_t durationNanos;
+            int stage;
+        };
+
+        struct ThreadData {
+            int id = 0;
+            char name[NAME_SIZE] = {};
+            std::atomic<bool> published{false};  // id and first name written
+            LatencyHistogram histograms[STAGE_COUNT];
+            std::unique_ptr<TraceEvent[]> events{};  // allocated by enableTrace
+            uint64_t eventCount = 0;  // total ever recorded, the ring keeps the last TRACE_EVENTS
+        };
+
+        std::unique_ptr<ThreadData[]> threads{new ThreadData[MAX_THREADS]};
+        std::atomic<int> claimedThreads{0};  // may run past MAX_THREADS
+        std::atomic<bool> tracing{false};
+        const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+        static void copyName(ThreadData& d, const char* name) {
+            std::strncpy(d.name, name, NAME_SIZE - 1);
+            d.name[NAME_SIZE - 1] = '\0';
+        }
+
+        // the calling thread's slot, claimed on first use (named name if given). nullptr once all
+        // slots are taken.
+        ThreadData* current(const char* name = nullptr) {
+            static thread_local ThreadData* data = nullptr;
+            static thread_local bool claimed = false;
+            if (!claimed) {
+                claimed = true;
+                int index = claimedThreads.fetch_add(1);
+                if (index < MAX_THREADS) {
+                    data = &threads[index];
+                    data->id = index + 1;
+                    if (name != nullptr) {
+                        copyName(*data, name);
+                    } else {
+                        std::snprintf(data->name, NAME_SIZE, "thread-%d", data->id);
+                    }
+                    data->published.store(true, std::memory_order_release);
+                }
+            } else if (name != nullptr && data != nullptr) {
+                copyName(*data, name);
+            }
+            return data;
+        }
+
+        int publishedThreads() const {
+            int n = claimedThreads.load();
+            return n < MAX_THREADS ? n : MAX_THREADS;
+        }
+
+    public:
+        Instrumentation() = default;
+        Instrumentation(const Instrumentation&) = delete;
+        Instrumentation operator=(const Instrumentation&) = delete;
+
+        static Instrumentation& instance() {
+            static Instrumentation instrumentation{};
+            return instrumentation;
+        }
+
+        static const char* stageName(int stage) {
+            static const char* names[STAGE_COUNT] = {"demux", "send_packet", "receive_frame", "generate",
+                                                     "texture_upload", "present", "audio_callback"};
+            return stage >= 0 && stage < STAGE_COUNT ? names[stage] : "unknown";
+        }
+
+        // nanoseconds since the instrumentation started, the time base of record().
+        uint64_t now() const {
+            return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - origin).count();
+        }
+
+        // names the calling thread in summaries and traces, best before its first record.
+        void nameThread(const char* name) { current(name); }
+
+        /*
+         * Allocates every slot's trace ring up front, so recording threads never do; the rings
+         * are only touched as events are written. Call before the recording threads start.
+         */
+        void enableTrace() {
+            if (isTracing()) {
+                return;
+            }
+            for (int i = 0; i < MAX_THREADS; i++) {
+                threads[i].events.reset(new TraceEvent[TRACE_EVENTS]);
+            }
+            tracing.store(true, std::memory_order_release);
+        }
+
+        bool isTracing() const { return tracing.load(std::memory_order_acquire); }
+
+        void record(Stage stage, uint64_t beginNanos, uint64_t endNanos) {
+            ThreadData* d = current();
+            if (d == nullptr) {
+                return;
+            }
+            uint64_t duration = endNanos > beginNanos ? endNanos - beginNanos : 0;
+            d->histograms[stage].record(duration);
+            if (isTracing()) {
+                d->events[d->eventCount % TRACE_EVENTS] = TraceEvent{beginNanos, duration, stage};
+                d->eventCount++;
+            }
+        }
+
+        // all threads merged.
+        void printSummary(std::ostream& os) {
+            os << "stage latency (us): count mean p50 p90 p99 p99.9 max" << endl;
+            int n = publishedThreads();
+            for (int s = 0; s < STAGE_COUNT; s++) {
+                LatencyHistogram merged{};
+                for (int i = 0; i < n; i++) {
+                    if (threads[i].published.load(std::memory_order_acquire)) {
+                        merged.add(threads[i].histograms[s]);
+                    }
+                }
+                if (merged.getCount() == 0) {
+                    continue;
+                }
+                os << "  " << stageName(s) << ": " << merged.getCount() << " " << merged.getMeanNanos() / 1e3
+                   << " " << merged.getPercentileNanos(50) / 1e3 << " " << merged.getPercentileNanos(90) / 1e3
+                   << " " << merged.getPercentileNanos(99) / 1e3 << " " << merged.getPercentileNanos(99.9) / 1e3
+                   << " " << merged.getMaxNanos() / 1e3 << endl;
+            }
+            if (claimedThreads.load() > MAX_THREADS) {
+                os << "  (" << claimedThreads.load() - MAX_THREADS << " threads past " << MAX_THREADS
+                   << " not recorded)" << endl;
+            }
+        }
+
+        // Chrome trace-event JSON (chrome://tracing, Perfetto): one complete event per recorded stage.
+        bool writeChromeTrace(const string& path) {
+            std::ofstream os{path, std::ios::trunc};
+            if (!os.is_open()) {
+                cout << "can not write trace: " << path << endl;
+                return false;
+            }
+            os << std::fixed << std::setprecision(3);
+            os << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+            bool first = true;
+            uint64_t written = 0;
+            for (int i = 0; i < publishedThreads(); i++) {
+                const ThreadData* t = &threads[i];
+                if (!t->published.load(std::memory_order_acquire)) {
+                    continue;
+                }
+                os << (first ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+                   << t->id << ", \"args\": {\"name\": \"" << t->name << "\"}}";
+                first = false;
+                if (t->events == nullptr) {
+                    continue;
+                }
+                uint64_t n = t->eventCount < TRACE_EVENTS ? t->eventCount : TRACE_EVENTS;
+                for (uint64_t j = t->eventCount - n; j < t->eventCount; j++) {
+                    const TraceEvent& e = t->events[j % TRACE_EVENTS];
+                    os << ",\n{\"name\": \"" << stageName(e.stage) << "\", \"cat\": \"player\", \"ph\": \"X\", "
+                       << "\"pid\": 1, \"tid\": " << t->id << ", \"ts\": " << e.beginNanos / 1e3
+                       << ", \"dur\": " << e.durationNanos / 1e3 << "}";
+                    written++;
+                }
+            }
+            os << "\n]}" << endl;
+            cout << "trace written: " << path << " events=" << written << endl;
+            return (bool)os;
+        }
+    };
+
+    // records the time from construction to destruction as one stage of the calling thread.
+    class StageTimer {
+        Instrumentation::Stage stage;
+        uint64_t begin;
+
+    public:
+        StageTimer(const StageTimer&) = delete;
+        StageTimer operator=(const StageTimer&) = delete;
+
+        explicit StageTimer(Instrumentation::Stage s) : stage(s), begin(Instrumentation::instance().now()) {}
+
+        ~StageTimer() {
+            Instrumentation& i = Instrumentation::instance();
+            i.record(stage, begin, i.now());
+        }
+    };
+
+}  // namespace ffmpegUtil
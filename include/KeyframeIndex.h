@@ -0,0 +1,191 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avformat.h>
+};
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "StreamInfoCache.h"
+
+namespace ffmpegUtil {
+
+    using std::cout;
+    using std::endl;
+    using std::string;
+
+    /*
+     * Sorted keyframe timestamps of one stream, in that stream's time base.
+     *
+     * Built lazily from the key packets the demuxer hands out, or loaded from the index file
+     * save() left in the stream info cache directory. The index knows how far it has seen the file, so a lookup past that
+     * point reports "unknown" and the caller falls back to the demuxer's own seeking.
+     */
+    class KeyframeIndex {
+        static const int VERSION = 2;
+
+        mutable std::mutex indexMutex{};
+        std::vector<int64_t> keyframes{};
+        AVRational timeBase{0, 1};
+        int64_t coveredUntil = AV_NOPTS_VALUE;  // every keyframe <= this is in the index
+        bool extending = true;                  // demuxing continues inside the covered range
+        bool complete = false;
+
+    public:
+        void reset(AVRational tb) {
+            std::lock_guard<std::mutex> lg(indexMutex);
+            keyframes.clear();
+            timeBase = tb;
+            coveredUntil = AV_NOPTS_VALUE;
+            extending = true;
+            complete = false;
+        }
+
+        /*
+         * Records a packet of the indexed stream. Packets are seen in demux order, so coverage
+         * only grows while reading continues from the start or from inside the covered range.
+         */
+        void addPacket(int64_t ts, bool key) {
+            if (ts == AV_NOPTS_VALUE) {
+                return;
+            }
+            std::lock_guard<std::mutex> lg(indexMutex);
+            if (key) {
+                auto it = std::lower_bound(keyframes.begin(), keyframes.end(), ts);
+                if (it == keyframes.end() || *it != ts) {
+                    keyframes.insert(it, ts);
+                }
+            }
+            if (extending && (coveredUntil == AV_NOPTS_VALUE ? key : ts > coveredUntil)) {
+                coveredUntil = ts;
+            }
+        }
+
+        // the demuxer jumped to ts, coverage only continues if ts is already covered.
+        void onDiscontinuity(int64_t ts) {
+            std::lock_guard<std::mutex> lg(indexMutex);
+            extending = coveredUntil != AV_NOPTS_VALUE && ts != AV_NOPTS_VALUE && ts <= coveredUntil;
+        }
+
+        // the demuxer hit the end of the file while extending coverage.
+        void markComplete() {
+            std::lock_guard<std::mutex> lg(indexMutex);
+            if (extending && coveredUntil != AV_NOPTS_VALUE) {
+                complete = true;
+            }
+        }
+
+        // @return the last keyframe at or before ts, AV_NOPTS_VALUE if the index can not tell.
+        int64_t findPreceding(int64_t ts) const {
+            std::lock_guard<std::mutex> lg(indexMutex);
+            if (keyframes.empty() || (!complete && (coveredUntil == AV_NOPTS_VALUE || ts > coveredUntil))) {
+                return AV_NOPTS_VALUE;
+            }
+            auto it = std::upper_bound(keyframes.begin(), keyframes.end(), ts);
+            if (it == keyframes.begin()) {
+                return keyframes.front();
+            }
+            return *(it - 1);
+        }
+
+        size_t size() const {
+            std::lock_guard<std::mutex> lg(indexMutex);
+            return keyframes.size();
+        }
+
+        bool isComplete() const {
+            std::lock_guard<std::mutex> lg(indexMutex);
+            return complete;
+        }
+
+        /*
+         * Loads the index saved for the local file at url, which lives next to its stream info
+         * cache entry and is only taken if path, size and mtime still match.
+         * @return false when there is no valid index.
+         */
+        bool load(const string& url) {
+            StreamInfoCache::FileIdentity id;
+            if (!StreamInfoCache::identify(url, id)) {
+                return false;
+            }
+            string path = StreamInfoCache::entryPath(id, ".keyframes");
+            std::ifstream is{path};
+            if (!is.is_open()) {
+                return false;
+            }
+            string line, tag;
+            int version = -1;
+            int64_t size = -1, mtime = -1;
+            AVRational tb{0, 1};
+            std::getline(is, line);
+            std::istringstream{line} >> tag >> version >> tb.num >> tb.den;
+            if (tag != "player-keyframes" || version != VERSION) {
+                cout << "invalid keyframe index: " << path << endl;
+                return false;
+            }
+            std::getline(is, line);
+            if (line != "path " + id.path) {
+                return false;
+            }
+            std::getline(is, line);
+            std::istringstream{line} >> tag >> size >> mtime;
+            if (size != id.size || mtime != id.mtime) {
+                cout << "keyframe index is stale: " << id.path << endl;
+                return false;
+            }
+            std::lock_guard<std::mutex> lg(indexMutex);
+            if (timeBase.num != 0 && av_cmp_q(tb, timeBase) != 0) {
+                cout << "keyframe index time base mismatch: " << path << endl;
+                return false;
+            }
+            std::vector<int64_t> loaded{};
+            int64_t ts;
+            while (is >> ts) {
+                loaded.push_back(ts);
+            }
+            std::sort(loaded.begin(), loaded.end());
+            keyframes.swap(loaded);
+            timeBase = tb;
+            complete = !keyframes.empty();
+            coveredUntil = complete ? keyframes.back() : AV_NOPTS_VALUE;
+            cout << "keyframe index loaded: " << path << " keyframes=" << keyframes.size() << endl;
+            return complete;
+        }
+
+        // saves a complete index for the local file at url, false for non-file urls.
+        bool save(const string& url) const {
+            StreamInfoCache::FileIdentity id;
+            if (!StreamInfoCache::identify(url, id)) {
+                return false;
+            }
+            std::lock_guard<std::mutex> lg(indexMutex);
+            if (!complete) {
+                return false;
+            }
+            string path = StreamInfoCache::entryPath(id, ".keyframes");
+            string tmpPath = path + ".tmp";
+            {
+                std::ofstream os{tmpPath, std::ios::trunc};
+                if (!os.is_open()) {
+                    return false;
+                }
+                os << "player-keyframes " << VERSION << " " << timeBase.num << " " << timeBase.den << "\n";
+                os << "path " << id.path << "\n";
+                os << "file " << id.size << " " << id.mtime << "\n";
+                for (auto ts : keyframes) {
+                    os << ts << "\n";
+                }
+                if (!os) {
+                    return false;
+                }
+            }
+            return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+        }
+    };
+
+}  // namespace ffmpegUtil
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <thread>
+
+#define PLAYER_LOG_DEBUG 0
+#define PLAYER_LOG_INFO 1
+#define PLAYER_LOG_WARN 2
+#define PLAYER_LOG_ERROR 3
+
+// levels below PLAYER_LOG_LEVEL are compiled out, arguments included.
+#ifndef PLAYER_LOG_LEVEL
+#define PLAYER_LOG_LEVEL PLAYER_LOG_INFO
+#endif
+
+#define PLAYER_LOG(level, ...)                                  \
+    do {                                                        \
+        ::ffmpegUtil::LogLine logLine_{level};                  \
+        logLine_.stream() << __VA_ARGS__;                       \
+    } while (0)
+
+#if PLAYER_LOG_LEVEL <= PLAYER_LOG_DEBUG
+#define LOG_DEBUG(...) PLAYER_LOG(PLAYER_LOG_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+#if PLAYER_LOG_LEVEL <= PLAYER_LOG_INFO
+#define LOG_INFO(...) PLAYER_LOG(PLAYER_LOG_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if PLAYER_LOG_LEVEL <= PLAYER_LOG_WARN
+#define LOG_WARN(...) PLAYER_LOG(PLAYER_LOG_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#define LOG_ERROR(...) PLAYER_LOG(PLAYER_LOG_ERROR, __VA_ARGS__)
+
+namespace ffmpegUtil {
+
+    /*
+     * Asynchronous log sink. Callers format into a thread-local fixed buffer and copy the line
+     * into a bounded lock-free ring (multi-producer, sequence-numbered slots), so logging never
+     * takes a lock, flushes or allocates on the calling thread; it is safe from the audio
+     * callback. A background thread writes the lines to stdout.
+     *
+     * A full ring drops the line rather than wait, the number dropped is reported with the next
+     * line written. Lines longer than LINE_SIZE are truncated.
+     */
+    class Logger {
+    public:
+        static const size_t LINE_SIZE = 240;
+
+    private:
+        static const size_t CAPACITY = 4096;  // power of two
+        static const size_t MASK = CAPACITY - 1;
+
+        struct Slot {
+            std::atomic<size_t> sequence{0};
+            int level = 0;
+            size_t length = 0;
+            char text[LINE_SIZE];
+        };
+
+        Slot slots[CAPACITY];
+        alignas(64) std::atomic<size_t> tail{0};
+        alignas(64) size_t head = 0;
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> closing{false};
+        std::mutex drainMutex{};  // one consumer at a time: the writer thread or flush()
+        std::thread writer{};
+
+        static const char* levelName(int level) {
+            switch (level) {
+                case PLAYER_LOG_DEBUG:
+                    return "[debug] ";
+                case PLAYER_LOG_WARN:
+                    return "[warn] ";
+                case PLAYER_LOG_ERROR:
+                    return "[error] ";
+                default:
+                    return "";
+            }
+        }
+
+        // @return the number of lines written.
+        size_t drain() {
+            std::lock_guard<std::mutex> lg(drainMutex);
+            size_t n = 0;
+            while (true) {
+                Slot& s = slots[head & MASK];
+                if (s.sequence.load(std::memory_order_acquire) != head + 1) {
+                    break;
+                }
+                uint64_t d = dropped.exchange(0, std::memory_order_relaxed);
+                if (d > 0) {
+                    std::cout << "[warn] logger dropped " << d << " lines\n";
+                }
+                std::cout << levelName(s.level);
+                std::cout.write(s.text, s.length);
+                std::cout.put('\n');
+                s.sequence.store(head + CAPACITY, std::memory_order_release);
+                head++;
+                n++;
+            }
+            if (n > 0) {
+                std::cout.flush();
+            }
+            return n;
+        }
+
+        void writerLoop() {
+            while (!closing.load()) {
+                if (drain() == 0) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }
+            }
+            drain();
+        }
+
+    public:
+        Logger() {
+            for (size_t i = 0; i < CAPACITY; i++) {
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+            writer = std::thread{&Logger::writerLoop, this};
+        }
+
+        Logger(const Logger&) = delete;
+        Logger operator=(const Logger&) = delete;
+
+        ~Logger() {
+            closing.store(true);
+            writer.join();
+        }
+
+        static Logger& instance() {
+            static Logger logger{};
+            return logger;
+        }
+
+        // never blocks. @return false if the ring was full and the line dropped.
+        bool push(int level, const char* text, size_t length) {
+            size_t pos = tail.load(std::memory_order_relaxed);
+            Slot* s;
+            while (true) {
+                s = &slots[pos & MASK];
+                size_t seq = s->sequence.load(std::memory_order_acquire);
+                auto diff = (intptr_t)seq - (intptr_t)pos;
+                if (diff == 0) {
+                    if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                } else {
+                    pos = tail.load(std::memory_order_relaxed);
+                }
+            }
+            s->level = level;
+            s->length = length < LINE_SIZE ? length : LINE_SIZE;
+            memcpy(s->text, text, s->length);
+            s->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        // writes everything logged so far before returning, for output that must follow it.
+        void flush() { drain(); }
+    };
+
+    /*
+     * One log line, formatted on the calling thread into a thread-local buffer and pushed to
+     * the Logger when it goes out of scope. Use through the LOG_* macros.
+     */
+    class LogLine {
+        class LineBuffer : public std::streambuf {
+            char text[Logger::LINE_SIZE];
+
+        public:
+            LineBuffer() { reset(); }
+
+            void reset() { setp(text, text + sizeof(text)); }
+
+            const char* data() const { return pbase(); }
+
+            size_t size() const { return (size_t)(pptr() - pbase()); }
+        };
+
+        struct LineStream {
+            LineBuffer buffer{};
+            std::ostream os{&buffer};
+        };
+
+        int level;
+        LineStream& line;
+
+        static LineStream& current() {
+            static thread_local LineStream line{};
+            return line;
+        }
+
+    public:
+        explicit LogLine(int l) : level(l), line(current()) {
+            line.buffer.reset();
+            line.os.clear();
+        }
+
+        LogLine(const LogLine&) = delete;
+        LogLine operator=(const LogLine&) = delete;
+
+        ~LogLine() { Logger::instance().push(level, line.buffer.data(), line.buffer.size()); }
+
+        std::ostream& stream() { return line.os; }
+    };
+
+}  // namespace ffmpegUtil
@@ -1,145 +1,561 @@
 #include "ffmpegUtil.h"
+#include "SpscQueue.hpp"
+#include "PacketPool.h"
+#include "TaskScheduler.h"
+#include "QualityController.h"
+#include "SliceConverter.h"
+#include "PcmFifo.h"
+#include "AvSync.h"
+#include "TempoFilter.h"
+#include "Instrumentation.h"
+#include "Logger.h"
 
 #include <iostream>
 #include <string>
-#include <list>
 #include <memory>
 #include <chrono>
 #include <thread>
 #include <atomic>
 #include <condition_variable>
 #include <mutex>
+#include <vector>
+#include <algorithm>
 
 using std::condition_variable;
-using std::cout;
-using std::endl;
-using std::list;
 using std::mutex;
 using std::shared_ptr;
 using std::string;
 using std::unique_ptr;
 
+/*
+ * Wakes the demux thread as soon as a processor's packet queue drops below its low-water mark
+ * (or gets room again while the reader is blocked on a full queue).
+ *
+ * Consumers only take the mutex when the reader is actually parked, so the packet path stays
+ * lock-free while the reader is busy.
+ */
+class PacketDemand {
+    mutex waitMutex{};
+    condition_variable waitCv{};
+    std::atomic<bool> readerWaiting{false};
+    std::atomic<uint64_t> wakeUps{0};
+
+public:
+    template <typename Predicate>
+    void wait(Predicate pred) {
+        std::unique_lock<std::mutex> lk{waitMutex};
+        readerWaiting.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!pred()) {
+            waitCv.wait(lk);
+            wakeUps++;
+        }
+        readerWaiting.store(false);
+    }
+
+    // called by consumers after they changed the state the reader's predicate looks at.
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (readerWaiting.load()) {
+            std::lock_guard<std::mutex> lg(waitMutex);
+            waitCv.notify_one();
+        }
+    }
+
+    uint64_t getWakeUps() const { return wakeUps.load(); }
+};
+
+// one decoded and converted frame, waiting in a processor's frame queue.
+struct DecodedFrame {
+    AVFrame* frame = nullptr;  // owns its buffers by reference, shared with the decoder when not converted
+    int64_t ptsUs = 0;          // from best_effort_timestamp
+    int64_t durationUs = 0;
+    int dataSize = 0;           // audio: bytes of interleaved samples in frame->data[0]
+    int samples = 0;            // audio: samples per channel
+    uint64_t generation = 0;    // frames of an older generation predate a seek
+    bool firstAfterSeek = false;
+};
+
 class MediaProcessor {
-    list<unique_ptr<AVPacket>> packetList{};
-    mutex pktListMutex{};
+    static constexpr int PKT_QUEUE_CAPACITY = 32;
+    static constexpr int DEFAULT_FRAME_QUEUE_SIZE = 4;
+
+    // reader thread -> nextFrameKeeper thread, a nullptr entry marks the end of the stream.
+    ffmpegUtil::SpscQueue<AVPacket*> packetQueue{PKT_QUEUE_CAPACITY};
     int PKT_WAITING_SIZE = 3;
-    bool started = false;
-    bool closed = false;
-    bool streamFinished = false;
+    PacketDemand* packetDemand = nullptr;
+    ffmpegUtil::PacketPool* packetPool = nullptr;
+    int packetPoolConsumer = -1;
+    bool starving = false;
+    std::atomic<uint64_t> starvationCount{0};
+    std::atomic<bool> started{false};
+    std::atomic<bool> closed{false};
+    std::atomic<bool> streamFinished{false};
+
+    // decode work runs as a task on a scheduler, or on a dedicated thread without one. the state
+    // makes sure at most one run is queued or running at a time.
+    enum DecodeTaskState { TASK_IDLE, TASK_QUEUED, TASK_RUNNING, TASK_RERUN, TASK_CLOSED };
+    ffmpegUtil::TaskScheduler* scheduler = nullptr;
+    std::thread decodeThread{};
+    std::atomic<bool> runnerStarted{false};
+    std::atomic<int> taskState{TASK_IDLE};
+    ffmpegUtil::TaskStats decodeStats{};
+    std::chrono::steady_clock::time_point startTime{};
+
+    enum DecoderState { DECODER_DECODING, DECODER_DRAINING, DECODER_DRAINED };
+    DecoderState decoderState = DECODER_DECODING;  // decode task only
+
+    // what queued the decode runs, and runs that found nothing to do.
+    std::atomic<uint64_t> packetWakeUps{0};
+    std::atomic<uint64_t> slotWakeUps{0};
+    std::atomic<uint64_t> emptyRuns{0};
+    std::atomic<uint64_t> generateNanos{0};
+    mutex taskMutex{};
+    condition_variable taskCv{};
 
     AVFrame* nextFrame = av_frame_alloc();
     AVPacket* targetPkt = nullptr;
+    int64_t nextPtsUs = 0;  // decoder: extrapolated pts for frames that come without one
+
+    // decoded frames: the keeper thread fills free slots and hands them over through readySlots,
+    // the consumer gives them back through freeSlots. frames are moved or converted in place.
+    int frameQueueSize = DEFAULT_FRAME_QUEUE_SIZE;
+    std::vector<DecodedFrame> frameSlots{};
+    unique_ptr<ffmpegUtil::SpscQueue<DecodedFrame*>> readySlots{};
+    unique_ptr<ffmpegUtil::SpscQueue<DecodedFrame*>> freeSlots{};
+    DecodedFrame* fillSlot = nullptr;  // keeper thread
+    std::atomic<uint64_t> frameGeneration{0};
+    std::atomic<uint64_t> consumedFrames{0};
+    std::atomic<uint64_t> queuedFramesSum{0};
+
+    // seek: pushed in place of a packet, everything queued before it predates the seek.
+    AVPacket flushMarker{};
+    std::atomic<int> pendingFlushes{0};
+    std::atomic<int64_t> flushTargetMs{-1};
+    int64_t dropBeforeMs = -1;
+    std::atomic<int64_t> seekRequestNs{0};
+    std::atomic<int64_t> lastSeekLatencyUs{-1};
+
+    // stream switch: decoder for the new stream, taken over when the flush marker arrives.
+    mutex switchMutex{};
+    AVCodecContext* pendingCodecCtx = nullptr;
+    int pendingStreamIndex = -1;
+    AVRational pendingTimeBase{1, 0};
+
+    // the scheduler keeps no pointer into the processor once the task returned, runs are counted
+    // by the task itself.
+    void submitDecodeTask() {
+        if (scheduler != nullptr) {
+            scheduler->submit([this] { runDecodeTask(); });
+        } else {
+            std::lock_guard<std::mutex> lg(taskMutex);
+            taskCv.notify_all();
+        }
+    }
 
-    void nextFrameKeeper() {
-        auto lastPrepareTime = std::chrono::system_clock::now();
-        while (!streamFinished && started) {
-            std::unique_lock<std::mutex> lk{nextDataMutex};
-            cv.wait(lk, [this] { return !started || !isNextDataReady.load(); });
-            if (!started) {
+    /*
+     * One decode run. The state change that ends it is its last access to the processor: from
+     * there on another run, or close() and the destructor, may own it.
+     */
+    void runDecodeTask() {
+        taskState.store(TASK_RUNNING);
+        // a drained decoder only runs again for a seek.
+        if (started && (decoderState != DECODER_DRAINED || pendingFlushes.load() > 0)) {
+            auto begin = std::chrono::steady_clock::now();
+            try {
+                prepareNextData();
+            } catch (std::runtime_error& e) {
+                LOG_ERROR("decode task failed, index=" << streamIndex << ": " << e.what());
+                decoderState = DECODER_DRAINED;
+                streamFinished = true;
+            }
+            decodeStats.runs++;
+            decodeStats.busyNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - begin).count();
+        }
+        if (started) {
+            int s = TASK_RUNNING;
+            if (taskState.compare_exchange_strong(s, TASK_IDLE)) {
+                return;
+            }
+            // woken while running. close() waits for the run queued here.
+            if (started) {
+                taskState.store(TASK_QUEUED);
+                submitDecodeTask();
+                return;
+            }
+        }
+        // closing, this is the last run. CLOSED is final, wakeDecoder never queues another one.
+        LOG_INFO("[TASK] decoder finished, index=" << streamIndex);
+        std::lock_guard<std::mutex> lg(taskMutex);
+        taskState.store(TASK_CLOSED);
+        taskCv.notify_all();
+    }
+
+    void decodeThreadLoop() {
+        ffmpegUtil::Instrumentation::instance().nameThread("decoder");
+        std::unique_lock<std::mutex> lk{taskMutex};
+        while (true) {
+            taskCv.wait(lk, [this] {
+                int s = taskState.load();
+                return s == TASK_QUEUED || s == TASK_CLOSED;
+            });
+            if (taskState.load() == TASK_CLOSED) {
                 break;
             }
-            auto prepareTime = std::chrono::system_clock::now();
-            std::chrono::duration<double> diff = prepareTime - lastPrepareTime;
-            lastPrepareTime = prepareTime;
-            prepareNextData();
+            lk.unlock();
+            runDecodeTask();
+            lk.lock();
+        }
+        LOG_INFO("[THREAD] decode thread finished, index=" << streamIndex);
+    }
+
+    // any thread: the state the decoder waits on changed, run it (again).
+    void wakeDecoder(std::atomic<uint64_t>* reason = nullptr) {
+        if (!runnerStarted) {
+            return;
+        }
+        int s = taskState.load();
+        while (true) {
+            if (s == TASK_IDLE) {
+                if (taskState.compare_exchange_weak(s, TASK_QUEUED)) {
+                    submitDecodeTask();
+                    break;
+                }
+            } else if (s == TASK_RUNNING) {
+                if (taskState.compare_exchange_weak(s, TASK_RERUN)) {
+                    break;
+                }
+            } else {
+                return;
+            }
+        }
+        if (reason != nullptr) {
+            (*reason)++;
         }
-        cout << "[THREAD] next frame keeper finished, index=" << streamIndex << endl;
-        started = false;
-        closed = true;
     }
 
 protected:
     std::atomic<uint64_t> currentTimestamp{0};
-    std::atomic<uint64_t> nextFrameTimestamp{0};
     AVRational streamTimeBase{1, 0};
     bool noMorePkt = false;
 
     int streamIndex = -1;
     AVCodecContext* codecCtx = nullptr;
+    ffmpegUtil::DecoderThreading decoderThreading{};
+
+    // converts (or moves) the decoded frame f into out->frame, on the keeper thread.
+    virtual void generateNextData(AVFrame* f, DecodedFrame* out) = 0;
 
-    condition_variable cv{};
-    mutex nextDataMutex{};
+    // decoder thread, codecCtx now decodes a different stream.
+    virtual void onStreamSwitched() {}
 
-    std::atomic<bool> isNextDataReady{false};
+    // decoder thread, before each decode run.
+    virtual void onDecodeRun() {}
 
-    virtual void generateNextData(AVFrame* f) = 0;
+    // caller of start(), before the first decode run. s is nullptr for a dedicated decode thread.
+    virtual void onStart(ffmpegUtil::TaskScheduler* s) {}
+
+    // decoder thread, false skips conversion of a decoded frame and drops it.
+    virtual bool keepFrame(const DecodedFrame* f) { return true; }
+
+    // p is owned by the queue from here on, except the flush marker. blocks while the queue is full.
+    void pushToQueue(AVPacket* p) {
+        while (!packetQueue.tryPush(std::move(p))) {
+            if (isClosing()) {
+                if (p != nullptr && p != &flushMarker) {
+                    av_packet_free(&p);
+                }
+                return;
+            }
+            if (packetDemand != nullptr) {
+                packetDemand->wait([this] {
+                    return isClosing() || packetQueue.size() < packetQueue.getCapacity();
+                });
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        wakeDecoder(&packetWakeUps);
+    }
+
+    void pushFlushMarker() {
+        pendingFlushes++;
+        pushToQueue(&flushMarker);
+    }
+
+    // reader thread, the decoder switches to ctx when it reaches the marker.
+    void queueStreamSwitch(AVCodecContext* ctx, int index, AVRational timeBase) {
+        {
+            std::lock_guard<std::mutex> lg(switchMutex);
+            if (pendingCodecCtx != nullptr) {
+                ffmpegUtil::ffUtils::freeCodecContext(&pendingCodecCtx);
+            }
+            pendingCodecCtx = ctx;
+            pendingStreamIndex = index;
+            pendingTimeBase = timeBase;
+        }
+        pushFlushMarker();
+    }
 
     unique_ptr<AVPacket> getNextPkt() {
-        if (noMorePkt) {
+        if (noMorePkt && pendingFlushes.load() == 0) {
             return nullptr;
         }
-        std::lock_guard<std::mutex> lg(pktListMutex);
-        if (packetList.empty()) {
-            return nullptr;
-        } else {
-            auto pkt = std::move(packetList.front());
+        while (true) {
+            AVPacket* pkt = nullptr;
+            if (!packetQueue.tryPop(pkt)) {
+                if (!starving) {
+                    starving = true;
+                    starvationCount++;
+                }
+                return nullptr;
+            }
+            starving = false;
+            if (packetDemand != nullptr) {
+                auto left = packetQueue.size();
+                if ((int)left < PKT_WAITING_SIZE || left + 1 == packetQueue.getCapacity()) {
+                    packetDemand->notify();
+                }
+            }
+            if (pkt == &flushMarker) {
+                flushDecoder();
+                continue;
+            }
+            if (pendingFlushes.load() > 0) {
+                // queued before the seek.
+                if (pkt != nullptr) {
+                    releasePkt(pkt);
+                }
+                continue;
+            }
             if (pkt == nullptr) {
                 noMorePkt = true;
                 return nullptr;
-            } else {
-                packetList.pop_front();
-                return pkt;
             }
+            return unique_ptr<AVPacket>(pkt);
+        }
+    }
+
+    void flushDecoder() {
+        AVCodecContext* newCodecCtx = nullptr;
+        {
+            std::lock_guard<std::mutex> lg(switchMutex);
+            std::swap(newCodecCtx, pendingCodecCtx);
+            if (newCodecCtx != nullptr) {
+                streamIndex = pendingStreamIndex;
+                streamTimeBase = pendingTimeBase;
+            }
+        }
+        if (newCodecCtx != nullptr) {
+            ffmpegUtil::ffUtils::freeCodecContext(&codecCtx);
+            codecCtx = newCodecCtx;
+            onStreamSwitched();
+        } else {
+            avcodec_flush_buffers(codecCtx);
+        }
+        if (targetPkt != nullptr) {
+            releasePkt(targetPkt);
+            targetPkt = nullptr;
+        }
+        if (newCodecCtx == nullptr) {
+            // frames decoded before a seek are skipped by the consumer.
+            frameGeneration++;
+        }
+        noMorePkt = false;
+        decoderState = DECODER_DECODING;
+        streamFinished = false;
+        if (newCodecCtx == nullptr) {
+            dropBeforeMs = flushTargetMs.load();
+        }
+        // a stream switch keeps the target of a seek still catching up, and never takes an old one.
+        pendingFlushes--;
+        LOG_INFO("decoder flushed, index=" << streamIndex << " target=" << dropBeforeMs << "ms");
+    }
+
+    uint64_t getFrameGeneration() const { return frameGeneration.load(); }
+
+    // consumer: the oldest decoded frame of the current generation, nullptr if there is none.
+    DecodedFrame* nextReady() {
+        DecodedFrame* f = nullptr;
+        while (readySlots->tryPop(f)) {
+            if (f->generation == frameGeneration.load()) {
+                queuedFramesSum += readySlots->size() + 1;
+                consumedFrames++;
+                return f;
+            }
+            returnSlot(f);
+        }
+        return nullptr;
+    }
+
+    // consumer: the frame was used, its slot can be filled again.
+    void returnSlot(DecodedFrame* f) {
+        freeSlots->tryPush(std::move(f));
+        wakeDecoder(&slotWakeUps);
+    }
+
+    // called by the consumer when it takes a frame, reports seek latency for the first one after a seek.
+    void onDataConsumed(const DecodedFrame* f) {
+        if (f->firstAfterSeek) {
+            auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+            lastSeekLatencyUs.store((now - seekRequestNs.load()) / 1000);
+            LOG_INFO("seek latency index=" << streamIndex << ": " << getLastSeekLatencyMs() << "ms");
+        }
+    }
+
+    void releasePkt(AVPacket* pkt) {
+        if (packetPool != nullptr) {
+            packetPool->release(packetPoolConsumer, pkt);
+        } else {
+            av_packet_free(&pkt);
+        }
+    }
+
+    // hands the decoded nextFrame to the consumer, or drops it while catching up with a seek.
+    void publishFrame() {
+        const AVRational microseconds{1, 1000000};
+        int64_t ts = nextFrame->best_effort_timestamp != AV_NOPTS_VALUE ? nextFrame->best_effort_timestamp
+                                                                        : nextFrame->pts;
+        int64_t ptsUs = ts != AV_NOPTS_VALUE ? av_rescale_q(ts, streamTimeBase, microseconds) : nextPtsUs;
+        int64_t durationUs = 0;
+        if (codecCtx->codec_type == AVMEDIA_TYPE_AUDIO && nextFrame->sample_rate > 0) {
+            durationUs = av_rescale(nextFrame->nb_samples, 1000000, nextFrame->sample_rate);
+        } else if (nextFrame->pkt_duration > 0) {
+            durationUs = av_rescale_q(nextFrame->pkt_duration, streamTimeBase, microseconds);
+        } else if (codecCtx->framerate.num > 0 && codecCtx->framerate.den > 0) {
+            durationUs = av_rescale_q(1, av_inv_q(codecCtx->framerate), microseconds);
+        }
+        nextPtsUs = ptsUs + durationUs;
+
+        fillSlot->firstAfterSeek = false;
+        if (dropBeforeMs >= 0) {
+            // decoding restarted at the keyframe before the seek target.
+            if (ts != AV_NOPTS_VALUE && ptsUs < dropBeforeMs * 1000) {
+                av_frame_unref(nextFrame);
+                return;
+            }
+            dropBeforeMs = -1;
+            fillSlot->firstAfterSeek = true;
+        }
+        fillSlot->ptsUs = ptsUs;
+        fillSlot->durationUs = durationUs;
+        fillSlot->generation = frameGeneration.load();
+        if (!keepFrame(fillSlot)) {
+            av_frame_unref(nextFrame);
+            return;
         }
+        auto& instrumentation = ffmpegUtil::Instrumentation::instance();
+        uint64_t generateBegin = instrumentation.now();
+        generateNextData(nextFrame, fillSlot);
+        uint64_t generateEnd = instrumentation.now();
+        instrumentation.record(ffmpegUtil::Instrumentation::GENERATE, generateBegin, generateEnd);
+        generateNanos += generateEnd - generateBegin;
+        readySlots->tryPush(std::move(fillSlot));
+        fillSlot = nullptr;
     }
 
+    /*
+     * Decoder state machine, one run per task. Output is taken before input is offered, so the
+     * decoder never refuses a packet twice. A run ends on one of the events that wakes it again:
+     * no free frame slot (consumer returns one), no queued packet (reader pushes one), or the
+     * stream fully drained.
+     */
     void prepareNextData() {
-        while (!isNextDataReady.load() && !streamFinished) {
-            if (targetPkt == nullptr) {
-                if (!noMorePkt) {
-                    auto pkt = getNextPkt();
-                    if (pkt != nullptr) {
-                        targetPkt = pkt.release();
-                    } else if (noMorePkt) {
-                        targetPkt = nullptr;
-                    } else {
-                        return;
-                    }
-                } else {
-                    cout << "++++++++ no more pkt index=" << streamIndex
-                         << " finished=" << streamFinished << endl;
+        auto& instrumentation = ffmpegUtil::Instrumentation::instance();
+        onDecodeRun();
+        bool progress = false;
+        bool inputRefused = false;
+        while (decoderState != DECODER_DRAINED || pendingFlushes.load() > 0) {
+            if (fillSlot == nullptr && !freeSlots->tryPop(fillSlot)) {
+                break;
+            }
+            if (decoderState != DECODER_DECODING && pendingFlushes.load() > 0) {
+                // a seek arrived behind the end of the stream, or after it.
+                auto pkt = getNextPkt();
+                if (pkt != nullptr) {
+                    targetPkt = pkt.release();
+                } else if (decoderState != DECODER_DECODING) {
+                    break;
                 }
             }
 
-            int ret = -1;
-            ret = avcodec_send_packet(codecCtx, targetPkt);
+            uint64_t receiveBegin = instrumentation.now();
+            int ret = avcodec_receive_frame(codecCtx, nextFrame);
+            instrumentation.record(ffmpegUtil::Instrumentation::RECEIVE_FRAME, receiveBegin, instrumentation.now());
             if (ret == 0) {
-                av_packet_free(&targetPkt);
-                targetPkt = nullptr;
-            } else if (ret == AVERROR(EAGAIN)) {
-
+                progress = true;
+                inputRefused = false;
+                publishFrame();
+                continue;
             } else if (ret == AVERROR_EOF) {
-
-                cout << "[WARN]  no new packets can be sent to it. index=" << streamIndex << endl;
-            } else {
-                string errorMsg = "+++++++++ ERROR avcodec_send_packet error: ";
-                errorMsg += ret;
-                cout << errorMsg << endl;
+                LOG_INFO("MediaProcessor no more output frames. index=" << streamIndex);
+                decoderState = DECODER_DRAINED;
+                streamFinished = true;
+                break;
+            } else if (ret != AVERROR(EAGAIN)) {
+                string errorMsg = "avcodec_receive_frame error: " + std::to_string(ret);
+                LOG_ERROR(errorMsg);
+                throw std::runtime_error(errorMsg);
+            } else if (inputRefused || decoderState == DECODER_DRAINING) {
+                string errorMsg = "decoder neither takes input nor gives output. index=" + std::to_string(streamIndex);
+                LOG_ERROR(errorMsg);
                 throw std::runtime_error(errorMsg);
             }
 
-            ret = avcodec_receive_frame(codecCtx, nextFrame);
+            // the decoder wants input.
+            if (targetPkt == nullptr) {
+                auto pkt = getNextPkt();
+                if (pkt != nullptr) {
+                    targetPkt = pkt.release();
+                } else if (!noMorePkt) {
+                    break;
+                }
+            }
+            uint64_t sendBegin = instrumentation.now();
+            ret = avcodec_send_packet(codecCtx, targetPkt);
+            instrumentation.record(ffmpegUtil::Instrumentation::SEND_PACKET, sendBegin, instrumentation.now());
             if (ret == 0) {
-
-                generateNextData(nextFrame);
-                isNextDataReady.store(true);
-            } else if (ret == AVERROR_EOF) {
-                cout << "+++++++++++++++++++++++++++++ MediaProcessor no more output frames. index="
-                     << streamIndex << endl;
-                streamFinished = true;
+                progress = true;
+                if (targetPkt != nullptr) {
+                    releasePkt(targetPkt);
+                    targetPkt = nullptr;
+                } else {
+                    decoderState = DECODER_DRAINING;
+                }
             } else if (ret == AVERROR(EAGAIN)) {
-
+                inputRefused = true;
+            } else if (ret == AVERROR_EOF) {
+                decoderState = DECODER_DRAINING;
             } else {
-                string errorMsg = "avcodec_receive_frame error: ";
-                errorMsg += ret;
-                cout << errorMsg << endl;
+                string errorMsg = "avcodec_send_packet error: " + std::to_string(ret);
+                LOG_ERROR(errorMsg);
                 throw std::runtime_error(errorMsg);
             }
         }
+        if (!progress) {
+            emptyRuns++;
+        }
     }
 
 public:
+    // the packet queue is cache line aligned, keep that for heap allocated processors.
+    static void* operator new(std::size_t size) {
+        void* p = nullptr;
+        if (posix_memalign(&p, 64, size) != 0) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+
+    static void operator delete(void* p) { free(p); }
+
     ~MediaProcessor() {
+        close();
+        if (decodeThread.joinable()) {
+            decodeThread.join();
+        }
 
         if (nextFrame != nullptr) {
             av_frame_free(&nextFrame);
@@ -150,73 +566,285 @@ public:
         }
 
         if (codecCtx != nullptr) {
-            avcodec_free_context(&codecCtx);
+            ffmpegUtil::ffUtils::freeCodecContext(&codecCtx);
+        }
+
+        if (pendingCodecCtx != nullptr) {
+            ffmpegUtil::ffUtils::freeCodecContext(&pendingCodecCtx);
+        }
+
+        for (auto& slot : frameSlots) {
+            av_frame_free(&slot.frame);
         }
 
         // important
-        for (auto& p : packetList) {
-            auto pkt = p.release();
-            av_packet_free(&pkt);
+        AVPacket* pkt = nullptr;
+        while (packetQueue.tryPop(pkt)) {
+            if (pkt != nullptr && pkt != &flushMarker) {
+                av_packet_free(&pkt);
+            }
         }
 
-        cout << "~MediaProcessor called. index=" << streamIndex << endl;
+        LOG_INFO("~MediaProcessor called. index=" << streamIndex);
     }
-    void start() {
+    /*
+     * Decoding runs as tasks on scheduler, the shared one by default. With nullptr the processor
+     * gets a dedicated decode thread instead.
+     */
+    void start(ffmpegUtil::TaskScheduler* taskScheduler = &ffmpegUtil::TaskScheduler::shared()) {
+        frameSlots.resize(frameQueueSize);
+        readySlots.reset(new ffmpegUtil::SpscQueue<DecodedFrame*>(frameQueueSize));
+        freeSlots.reset(new ffmpegUtil::SpscQueue<DecodedFrame*>(frameQueueSize));
+        for (auto& slot : frameSlots) {
+            slot.frame = av_frame_alloc();
+            DecodedFrame* f = &slot;
+            freeSlots->tryPush(std::move(f));
+        }
         started = true;
-        std::thread keeper{&MediaProcessor::nextFrameKeeper, this};
-        keeper.detach();
+        startTime = std::chrono::steady_clock::now();
+        scheduler = taskScheduler;
+        onStart(scheduler);
+        if (scheduler == nullptr) {
+            decodeThread = std::thread{&MediaProcessor::decodeThreadLoop, this};
+        }
+        runnerStarted = true;
+        taskState.store(TASK_QUEUED);
+        submitDecodeTask();
     }
 
+    /*
+     * Stops decoding and returns once the last decode run has exited, so the processor can go.
+     * Safe to call again, the destructors always do.
+     */
     bool close() {
         started = false;
-        int c = 5;
-        while (!closed && c > 0) {
-            c--;
-            cv.notify_one();
-            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        if (packetDemand != nullptr) {
+            packetDemand->notify();
+        }
+        if (runnerStarted) {
+            // a run that missed started going false is woken again, the next one finishes.
+            wakeDecoder();
+            std::unique_lock<std::mutex> lk{taskMutex};
+            taskCv.wait(lk, [this] { return taskState.load() == TASK_CLOSED; });
+        } else {
+            taskState.store(TASK_CLOSED);
+        }
+        closed = true;
+        {
+            std::lock_guard<std::mutex> lg(taskMutex);
+            taskCv.notify_all();
+        }
+        if (decodeThread.joinable()) {
+            decodeThread.join();
         }
         return closed;
     }
 
     bool isClosed() { return closed; }
 
-    void pushPkt(unique_ptr<AVPacket> pkt) {
-        std::lock_guard<std::mutex> lg(pktListMutex);
-        packetList.push_back(std::move(pkt));
+    bool isClosing() { return !started || closed; }
+
+    void setPacketDemand(PacketDemand* demand) { packetDemand = demand; }
+
+    // consumed packets go back to the pool instead of being freed, call before start().
+    void setPacketPool(ffmpegUtil::PacketPool* pool) {
+        packetPool = pool;
+        packetPoolConsumer = pool->addConsumer();
+    }
+
+    // only called from the reader thread. blocks while the queue is full.
+    void pushPkt(unique_ptr<AVPacket> pkt) { pushToQueue(pkt.release()); }
+
+    /*
+     * Reader thread, right after repositioning the demuxer: drops every packet still queued,
+     * flushes the decoder once the marker gets through, and skips decoded output before
+     * targetMs so playback resumes exactly at the target.
+     */
+    void seekFlush(int64_t targetMs, std::chrono::steady_clock::time_point requestTime) {
+        seekRequestNs.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                requestTime.time_since_epoch()).count());
+        flushTargetMs.store(targetMs);
+        pushFlushMarker();
+    }
+
+    // request to first displayed (or played) data of the last seek, -1 before any seek.
+    double getLastSeekLatencyMs() const {
+        auto us = lastSeekLatencyUs.load();
+        return us < 0 ? -1 : us / 1000.0;
     }
+
+    // the decoder drained at the end of the stream. a seek starts it again, the processor stays open.
     bool isStreamFinished() { return streamFinished; }
 
-    bool needPacket() {
-        bool need;
-        std::lock_guard<std::mutex> lg(pktListMutex);
-        need = packetList.size() < PKT_WAITING_SIZE;
-        return need;
+    // runs and busy time of this processor's decode tasks.
+    const ffmpegUtil::TaskStats& getDecodeStats() const { return decodeStats; }
+
+    uint64_t getPacketWakeUps() const { return packetWakeUps.load(); }
+
+    uint64_t getSlotWakeUps() const { return slotWakeUps.load(); }
+
+    // decode runs that neither took a packet nor produced a frame.
+    uint64_t getEmptyRuns() const { return emptyRuns.load(); }
+
+    // time the decode tasks spent in generateNextData (conversion or resampling), part of the busy time.
+    double getGenerateMs() const { return generateNanos.load() / 1e6; }
+
+    // share of the time since start() this processor did not occupy a core.
+    double getDecodeIdleRatio() const {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+        return elapsed.count() > 0 ? std::max(0.0, 1 - decodeStats.getBusyMs() / elapsed.count()) : 0;
     }
 
+    // how many decoded frames may wait for the consumer, call before start().
+    void setFrameQueueSize(int size) { frameQueueSize = std::max(1, size); }
+
+    int getFrameQueueSize() const { return frameQueueSize; }
+
+    // decoded frames waiting for the consumer right now.
+    int getQueuedFrames() const { return readySlots != nullptr ? (int)readySlots->size() : 0; }
+
+    // the stream finished and the consumer took every frame decoded before that.
+    bool isDrained() { return isStreamFinished() && getQueuedFrames() == 0; }
+
+    // queue occupancy seen by the consumer, averaged over the frames it took.
+    double getAverageQueuedFrames() const {
+        auto n = consumedFrames.load();
+        return n == 0 ? 0 : (double)queuedFramesSum.load() / n;
+    }
+
+    bool needPacket() { return (int)packetQueue.size() < PKT_WAITING_SIZE; }
+
+    uint64_t getStarvationCount() const { return starvationCount.load(); }
+
     uint64_t getPts() { return currentTimestamp.load(); }
 };
 
 class AudioProcessor : public MediaProcessor {
+    static constexpr int PCM_FIFO_MS = 200;
+    static constexpr int FEED_INTERVAL_MS = 5;
+
     std::unique_ptr<ffmpegUtil::ReSampler> reSampler{};
 
-    uint8_t* outBuffer = nullptr;
-    int outBufferSize = -1;
-    int outDataSize = -1;
     int outSamples = -1;
 
     ffmpegUtil::AudioInfo inAudio;
     ffmpegUtil::AudioInfo outAudio;
 
+    // playback: the feeder thread moves decoded frames into the fifo, the device callback drains it.
+    std::unique_ptr<ffmpegUtil::PcmFifo> pcmFifo{};
+    int bytesPerSecond = 0;
+    std::thread feedThread{};
+    std::atomic<bool> feeding{false};
+    DecodedFrame* feedFrame = nullptr;  // feeder thread, written up to feedOffset
+    int feedOffset = 0;
+    uint64_t feedGeneration = 0;
+    ffmpegUtil::AudioClock clock{};
+
+    // time stretch after the resampler while the playback rate is not 1. decoder thread, except
+    // for playbackRate. stretched pcm gets its pts from the samples the filter put out.
+    std::atomic<double> playbackRate{1.0};
+    std::unique_ptr<ffmpegUtil::TempoFilter> tempo{};
+    AVFrame* stretchInput = av_frame_alloc();
+    int64_t stretchOriginUs = 0;
+    int64_t stretchedSamples = 0;
+
+    void releaseFeedFrame() {
+        if (feedFrame != nullptr) {
+            returnSlot(feedFrame);
+            feedFrame = nullptr;
+        }
+    }
+
+    // feeder thread. @return true if anything was written to the fifo.
+    bool feedPcm() {
+        uint64_t generation = getFrameGeneration();
+        if (generation != feedGeneration) {
+            // a seek: pcm queued before it stops playing now, not once the first new frame is decoded.
+            releaseFeedFrame();
+            feedGeneration = generation;
+            pcmFifo->discard();
+        }
+        bool wrote = false;
+        while (true) {
+            if (feedFrame == nullptr) {
+                feedFrame = nextReady();
+                if (feedFrame == nullptr) {
+                    break;
+                }
+                feedOffset = 0;
+                if (feedFrame->generation != feedGeneration) {
+                    // another seek since the check above.
+                    feedGeneration = feedFrame->generation;
+                    pcmFifo->discard();
+                }
+                onDataConsumed(feedFrame);
+            }
+            if (feedOffset < feedFrame->dataSize) {
+                int64_t pts = feedOffset == 0 ? feedFrame->ptsUs : -1;
+                size_t n = pcmFifo->write(feedFrame->frame->data[0] + feedOffset, feedFrame->dataSize - feedOffset,
+                                          pts);
+                if (n == 0) {
+                    break;
+                }
+                wrote = true;
+                feedOffset += (int)n;
+                if (feedOffset < feedFrame->dataSize) {
+                    break;
+                }
+            }
+            releaseFeedFrame();
+        }
+        return wrote;
+    }
+
+    void feedLoop() {
+        ffmpegUtil::Instrumentation::instance().nameThread("audio-feed");
+        const std::chrono::milliseconds interval{(int)FEED_INTERVAL_MS};  // a copy, the member has no definition
+        while (feeding.load()) {
+            if (!feedPcm()) {
+                std::this_thread::sleep_for(interval);
+            }
+        }
+        releaseFeedFrame();
+    }
+
 protected:
-    void generateNextData(AVFrame* frame) final override {
-        if (outBuffer == nullptr) {
-            outBufferSize = reSampler->allocDataBuf(&outBuffer, frame->nb_samples);
-        } else {
-            memset(outBuffer, 0, outBufferSize);
+    void generateNextData(AVFrame* frame, DecodedFrame* out) final override {
+        double rate = playbackRate.load();
+        if (rate == 1.0) {
+            tempo.reset();
+            std::tie(out->samples, out->dataSize) = reSampler->reSample(out->frame, frame);
+            outSamples = out->samples;
+            return;
+        }
+        if (tempo == nullptr || tempo->getRate() != rate || out->firstAfterSeek) {
+            if (tempo == nullptr || tempo->getRate() != rate) {
+                tempo.reset(new ffmpegUtil::TempoFilter(outAudio, rate));
+            } else {
+                tempo->reset();
+            }
+            stretchOriginUs = out->ptsUs;
+            stretchedSamples = 0;
         }
-        std::tie(outSamples, outDataSize) = reSampler->reSample(outBuffer, outBufferSize, frame);
-        auto t = frame->pts * av_q2d(streamTimeBase) * 1000;
-        nextFrameTimestamp.store((uint64_t)t);
+        if (!av_frame_is_writable(stretchInput)) {
+            av_frame_unref(stretchInput);  // still referenced by the filter graph
+        }
+        reSampler->reSample(stretchInput, frame);
+        std::tie(out->samples, out->dataSize) = tempo->process(stretchInput, out->frame);
+        out->ptsUs = stretchOriginUs + (int64_t)(stretchedSamples * rate * 1000000 / outAudio.sampleRate);
+        out->durationUs = (int64_t)(out->samples * rate * 1000000 / outAudio.sampleRate);
+        stretchedSamples += out->samples;
+        if (out->samples > 0) {
+            outSamples = out->samples;
+        }
+    }
+
+    // the output format stays the one the audio device was opened with.
+    void onStreamSwitched() override {
+        inAudio = ffmpegUtil::AudioInfo(codecCtx->channel_layout, codecCtx->sample_rate, codecCtx->channels,
+                                        codecCtx->sample_fmt);
+        reSampler.reset(new ffmpegUtil::ReSampler(inAudio, outAudio));
+        LOG_INFO("audio switched to stream " << streamIndex);
     }
 
 
@@ -225,26 +853,33 @@ public:
     AudioProcessor(AudioProcessor&&) noexcept = delete;
     AudioProcessor operator=(const AudioProcessor&) = delete;
     ~AudioProcessor() {
-        if (outBuffer != nullptr) {
-            av_freep(&outBuffer);
+        // decode tasks call into this class, stop them before its members go.
+        close();
+        feeding = false;
+        if (feedThread.joinable()) {
+            feedThread.join();
         }
-        cout << "AudioProcessor() called." << endl;
+        av_frame_free(&stretchInput);
+        LOG_INFO("AudioProcessor() called.");
     }
 
-    AudioProcessor(AVFormatContext* formatCtx) {
-        for (int i = 0; i < formatCtx->nb_streams; i++) {
-            if (formatCtx->streams[i]->codec->codec_type == AVMEDIA_TYPE_AUDIO) {
+    // index: the audio stream to decode, -1 for the first one.
+    AudioProcessor(AVFormatContext* formatCtx, int index = -1,
+                   const ffmpegUtil::DecoderThreading& threading = ffmpegUtil::DecoderThreading()) {
+        decoderThreading = threading;
+        for (int i = index >= 0 ? index : 0; i < formatCtx->nb_streams; i++) {
+            if (formatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
                 streamTimeBase = formatCtx->streams[i]->time_base;
                 streamIndex = i;
-                cout << "audio stream index = : " << i << " tb.n" << streamTimeBase.num << endl;
+                LOG_INFO("audio stream index = : " << i << " tb.n" << streamTimeBase.num);
                 break;
             }
         }
         if (streamIndex < 0) {
-            cout << " can not find audio stream." << endl;
+            LOG_ERROR(" can not find audio stream.");
         }
 
-        ffmpegUtil::ffUtils::initCodecContext(formatCtx, streamIndex, &codecCtx);
+        ffmpegUtil::ffUtils::initCodecContext(formatCtx, streamIndex, &codecCtx, decoderThreading);
 
         int64_t inLayout = codecCtx->channel_layout;
         int inSampleRate = codecCtx->sample_rate;
@@ -257,31 +892,94 @@ public:
         reSampler.reset(new ffmpegUtil::ReSampler(inAudio, outAudio));
     }
 
+    /*
+     * Reader thread, paired with PacketGrabber::selectAudioStream(index): packets still queued for the
+     * old stream are dropped and decoding continues with index.
+     */
+    void switchStream(AVFormatContext* formatCtx, int index) {
+        AVCodecContext* ctx = nullptr;
+        ffmpegUtil::ffUtils::initCodecContext(formatCtx, index, &ctx, decoderThreading);
+        queueStreamSwitch(ctx, index, formatCtx->streams[index]->time_base);
+    }
+
     int getAudioIndex() const { return streamIndex; }
 
     int getSamples() { return outSamples; }
 
+    /*
+     * Playback: starts the feeder thread that keeps a PCM fifo of PCM_FIFO_MS filled ahead of the
+     * device, writeAudioData plays from it. Call after start(), and use either this or
+     * skipAudioData.
+     */
+    void startPcmFeed() {
+        bytesPerSecond = outAudio.sampleRate * outAudio.channels * av_get_bytes_per_sample(outAudio.format);
+        pcmFifo.reset(new ffmpegUtil::PcmFifo((size_t)bytesPerSecond * PCM_FIFO_MS / 1000));
+        feeding = true;
+        feedThread = std::thread{&AudioProcessor::feedLoop, this};
+    }
+
+    // audio device callback: fills len bytes from the fifo, silence where it ran dry. never blocks,
+    // locks or allocates.
     void writeAudioData(uint8_t* stream, int len) {
-        static uint8_t* silenceBuff = nullptr;
-        if (silenceBuff == nullptr) {
-            silenceBuff = (uint8_t*)av_malloc(sizeof(uint8_t) * len);
-            std::memset(silenceBuff, 0, len);
+        if (pcmFifo == nullptr || (pcmFifo->getFilledBytes() == 0 && isStreamFinished())) {
+            std::memset(stream, 0, len);
+            return;
+        }
+        auto now = ffmpegUtil::steadyNanos();
+        double rate = playbackRate.load(std::memory_order_relaxed);
+        int64_t startUs = pcmFifo->getReadPtsUs((int)(bytesPerSecond / rate));
+        size_t n = pcmFifo->read(stream, len);
+        if (startUs >= 0) {
+            clock.update(startUs, startUs + (int64_t)(n * rate * 1000000 / bytesPerSecond), now);
+            currentTimestamp.store(startUs / 1000);
         }
+    }
 
-        if (isNextDataReady.load()) {
-            std::lock_guard<std::mutex> lock(nextDataMutex);
-            currentTimestamp.store(nextFrameTimestamp.load());
-            if (outDataSize != len) {
-                cout << "WARNING: outDataSize[" << outDataSize << "] != len[" << len << "]" << endl;
-            }
-            std::memcpy(stream, outBuffer, outDataSize);
-            isNextDataReady.store(false);
-        } else {
+    /*
+     * Stream seconds played per second, 0.5 to 4 in practice: pcm decoded from now on is time
+     * stretched to it (pitch kept) and the clock advances at it. Pcm already in the fifo plays at
+     * the rate it was made for.
+     */
+    void setPlaybackRate(double rate) {
+        playbackRate.store(rate);
+        clock.setRate(rate);
+    }
+
+    double getPlaybackRate() const { return playbackRate.load(); }
 
-            cout << " writeAudioData, audio data not ready." << endl;
-            std::memcpy(stream, silenceBuff, len);
+    // the time the audio device buffers, e.g. one period of the obtained SDL_AudioSpec.
+    void setDeviceLatencyUs(int64_t us) { clock.setLatencyUs(us); }
+
+    // stream time being heard now, interpolated and latency compensated, -1 before playback.
+    int64_t getClockUs() const { return clock.getUs(); }
+
+    // device callbacks that ran out of pcm, and the milliseconds of silence they played instead.
+    uint64_t getUnderruns() const { return pcmFifo != nullptr ? pcmFifo->getUnderruns() : 0; }
+
+    double getUnderrunMs() const {
+        return pcmFifo != nullptr && bytesPerSecond > 0 ? pcmFifo->getUnderrunBytes() * 1000.0 / bytesPerSecond : 0;
+    }
+
+    // pcm queued for the device right now.
+    double getPcmFilledMs() const {
+        return pcmFifo != nullptr && bytesPerSecond > 0 ? pcmFifo->getFilledBytes() * 1000.0 / bytesPerSecond : 0;
+    }
+
+    double getPcmFifoMs() const {
+        return pcmFifo != nullptr && bytesPerSecond > 0 ? pcmFifo->getCapacity() * 1000.0 / bytesPerSecond : 0;
+    }
+
+    // consumes the next decoded chunk without playing it, for headless runs.
+    // @return false if none is ready.
+    bool skipAudioData() {
+        DecodedFrame* data = nextReady();
+        if (data == nullptr) {
+            return false;
         }
-        cv.notify_one();
+        currentTimestamp.store(data->ptsUs / 1000);
+        onDataConsumed(data);
+        returnSlot(data);
+        return true;
     }
 
     int getOutChannels() const { return outAudio.channels; }
@@ -298,85 +996,195 @@ public:
 };
 
 class VideoProcessor : public MediaProcessor {
-    struct SwsContext* sws_ctx = nullptr;
-    AVFrame* outPic = nullptr;
+    ffmpegUtil::SliceConverter converter{nullptr};
+    DecodedFrame* displaySlot = nullptr;  // consumer: frame between getFrame and refreshFrame
+
+    // formats the renderer takes as is, frames in other formats are converted to the first one.
+    std::vector<AVPixelFormat> outputFormats{AV_PIX_FMT_YUV420P};
+    std::atomic<uint64_t> passedFrames{0};
+    std::atomic<uint64_t> convertedFrames{0};
+    std::atomic<uint64_t> convertedBytes{0};
+
+    // decode degradation while video is behind the master clock.
+    ffmpegUtil::QualityController quality{};
+    int appliedLevel = ffmpegUtil::QualityController::FULL;  // decoder thread
+    bool appliedFastPlayback = false;                         // decoder thread
+    std::atomic<double> playbackRate{1.0};
+    std::atomic<int64_t> masterClockMs{-1};
+    std::atomic<int64_t> masterClockNs{0};
+    std::atomic<uint64_t> droppedFrames{0};
 
 protected:
-    void generateNextData(AVFrame* frame) override {
-        auto t = frame->pts * av_q2d(streamTimeBase) * 1000;
-        nextFrameTimestamp.store((uint64_t)t);
-        sws_scale(sws_ctx, (uint8_t const* const*)frame->data, frame->linesize, 0,
-                  codecCtx->height, outPic->data, outPic->linesize);
+    void onDecodeRun() override {
+        int l = quality.getLevel();
+        bool fast = playbackRate.load() >= SKIP_NONREF_RATE;
+        if (l == appliedLevel && fast == appliedFastPlayback) {
+            return;
+        }
+        appliedLevel = l;
+        appliedFastPlayback = fast;
+        codecCtx->skip_loop_filter = l >= ffmpegUtil::QualityController::SKIP_LOOP_FILTER ? AVDISCARD_ALL
+                                                                                        : AVDISCARD_DEFAULT;
+        codecCtx->skip_frame = l >= ffmpegUtil::QualityController::SKIP_NONREF || fast ? AVDISCARD_NONREF
+                                                                                       : AVDISCARD_DEFAULT;
+    }
+
+    bool keepFrame(const DecodedFrame* f) override {
+        if (appliedLevel < ffmpegUtil::QualityController::DROP_LATE || masterClockMs.load() < 0) {
+            return true;
+        }
+        auto nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t clockMs = masterClockMs.load() + (int64_t)((nowNs - masterClockNs.load()) / 1000000 * playbackRate.load());
+        if ((f->ptsUs + f->durationUs) / 1000 >= clockMs) {
+            return true;
+        }
+        droppedFrames++;
+        return false;
+    }
+
+    // slices run on the decode scheduler, or all on the decode thread without one.
+    void onStart(ffmpegUtil::TaskScheduler* s) override { converter.setScheduler(s); }
+
+    void generateNextData(AVFrame* frame, DecodedFrame* out) override {
+        AVFrame* pic = out->frame;
+        if (std::find(outputFormats.begin(), outputFormats.end(), frame->format) != outputFormats.end()) {
+            // already what the renderer takes, keep the decoder's buffers.
+            av_frame_unref(pic);
+            av_frame_move_ref(pic, frame);
+            passedFrames++;
+            return;
+        }
+        AVPixelFormat target = outputFormats.front();
+        // a slot that passed a frame through still shares the decoder's buffer, which may be a
+        // reference picture. only a buffer the slot owns alone is converted into.
+        if (pic->buf[0] == nullptr || !av_frame_is_writable(pic) || pic->format != target ||
+            pic->width != frame->width || pic->height != frame->height) {
+            av_frame_unref(pic);
+            pic->format = target;
+            pic->width = frame->width;
+            pic->height = frame->height;
+            if (av_frame_get_buffer(pic, 32) < 0) {
+                throw std::runtime_error("can not allocate video frame.");
+            }
+        }
+        converter.convert(frame, pic);
+        convertedFrames++;
+        convertedBytes += av_image_get_buffer_size(target, frame->width, frame->height, 1);
     }
 
 public:
+    // playback rate from which non-reference frames are skipped at decode time.
+    static constexpr double SKIP_NONREF_RATE = 2.0;
+
     VideoProcessor(const VideoProcessor&) = delete;
     VideoProcessor(VideoProcessor&&) noexcept = delete;
     VideoProcessor operator=(const VideoProcessor&) = delete;
     ~VideoProcessor() {
-        if (sws_ctx != nullptr) {
-            sws_freeContext(sws_ctx);
-            sws_ctx = nullptr;
-        }
-
-        if (outPic != nullptr) {
-            av_frame_free(&outPic);
-        }
-        cout << "VideoProcessor() called." << endl;
+        close();
+        LOG_INFO("VideoProcessor() called.");
     }
 
-    VideoProcessor(AVFormatContext* formatCtx) {
-        for (int i = 0; i < formatCtx->nb_streams; i++) {
-            if (formatCtx->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO) {
+    // index: the video stream to decode, -1 for the first one.
+    VideoProcessor(AVFormatContext* formatCtx, int index = -1,
+                   const ffmpegUtil::DecoderThreading& threading = ffmpegUtil::DecoderThreading()) {
+        decoderThreading = threading;
+        for (int i = index >= 0 ? index : 0; i < formatCtx->nb_streams; i++) {
+            if (formatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
                 streamIndex = i;
                 streamTimeBase = formatCtx->streams[i]->time_base;
-                cout << "video stream index = :" << i << "tb.n" << streamTimeBase.num << endl;
+                LOG_INFO("video stream index = :" << i << "tb.n" << streamTimeBase.num);
                 break;
             }
         }
 
         if (streamIndex < 0) {
-            cout << " can not find video stream." << endl;
+            LOG_ERROR(" can not find video stream.");
         }
 
-        ffmpegUtil::ffUtils::initCodecContext(formatCtx, streamIndex, &codecCtx);
+        ffmpegUtil::ffUtils::initCodecContext(formatCtx, streamIndex, &codecCtx, decoderThreading);
 
-        int w = codecCtx->width;
-        int h = codecCtx->height;
+    }
 
-        sws_ctx = sws_getContext(w, h, codecCtx->pix_fmt, w, h, AV_PIX_FMT_YUV420P, SWS_BILINEAR,
-                                 NULL, NULL, NULL);
+    int getVideoIndex() const { return streamIndex; }
 
-        int numBytes = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, w, h, 32);
-        outPic = av_frame_alloc();
-        uint8_t* buffer = (uint8_t*)av_malloc(numBytes * sizeof(uint8_t));
-        av_image_fill_arrays(outPic->data, outPic->linesize, buffer, AV_PIX_FMT_YUV420P, w, h, 32);
+    // display formats offered by the renderer, preferred conversion target first. call before start().
+    void setOutputFormats(const std::vector<AVPixelFormat>& formats) {
+        if (!formats.empty()) {
+            outputFormats = formats;
+        }
     }
 
-    int getVideoIndex() const { return streamIndex; }
+    uint64_t getPassedFrames() const { return passedFrames.load(); }
+
+    uint64_t getConvertedFrames() const { return convertedFrames.load(); }
+
+    // bytes written by pixel format conversion, per frame handed to the renderer.
+    double getConvertBytesPerFrame() const {
+        auto n = passedFrames.load() + convertedFrames.load();
+        return n == 0 ? 0 : (double)convertedBytes.load() / n;
+    }
+
+    // slice-parallel conversion of the frames that are not in a display format.
+    const ffmpegUtil::SliceConverter& getConverter() const { return converter; }
+
+    /*
+     * Presenting thread: video is lateMs behind the master clock, which reads clockMs now.
+     * Drives how much decode work is skipped.
+     */
+    void reportLateness(int64_t lateMs, int64_t clockMs) {
+        masterClockNs.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+        masterClockMs.store(clockMs);
+        quality.report(lateMs);
+    }
+
+    const ffmpegUtil::QualityController& getQualityController() const { return quality; }
+
+    /*
+     * Stream seconds presented per second. From SKIP_NONREF_RATE on, non-reference frames are
+     * not decoded at all: there would be no time to show them.
+     */
+    void setPlaybackRate(double rate) { playbackRate.store(rate); }
+
+    double getPlaybackRate() const { return playbackRate.load(); }
+
+    // frames dropped before conversion because they were already late.
+    uint64_t getDroppedFrames() const { return droppedFrames.load(); }
 
     AVFrame* getFrame() {
-        if (isNextDataReady.load()) {
-            currentTimestamp.store(nextFrameTimestamp.load());
-            return outPic;
+        if (displaySlot == nullptr) {
+            displaySlot = nextReady();
+        }
+        if (displaySlot != nullptr) {
+            currentTimestamp.store(displaySlot->ptsUs / 1000);
+            return displaySlot->frame;
         } else {
-            cout << " getFrame, video data not ready." << endl;
+            LOG_WARN(" getFrame, video data not ready.");
             return nullptr;
         }
     }
 
     bool refreshFrame() {
-        if (isNextDataReady.load()) {
-            currentTimestamp.store(nextFrameTimestamp.load());
-            isNextDataReady.store(false);
-            cv.notify_one();
+        if (displaySlot == nullptr) {
+            displaySlot = nextReady();
+        }
+        if (displaySlot != nullptr) {
+            currentTimestamp.store(displaySlot->ptsUs / 1000);
+            onDataConsumed(displaySlot);
+            returnSlot(displaySlot);
+            displaySlot = nullptr;
             return true;
         } else {
-            cv.notify_one();
             return false;
         }
     }
 
+    // pts and duration of the frame returned by getFrame, in microseconds.
+    int64_t getFramePtsUs() const { return displaySlot != nullptr ? displaySlot->ptsUs : -1; }
+
+    int64_t getFrameDurationUs() const { return displaySlot != nullptr ? displaySlot->durationUs : 0; }
+
     int getWidth() const {
         if (codecCtx != nullptr) {
             return codecCtx->width;
@@ -0,0 +1,172 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avformat.h>
+};
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+namespace ffmpegUtil {
+
+    using std::cout;
+    using std::endl;
+    using std::string;
+
+    /*
+     * AVIOContext backed by a read-only mmap of a local file.
+     *
+     * libavformat still copies from the mapping into its own IO buffer (the public API has no way
+     * to hand it foreign memory), but that copy replaces the read() syscall and the kernel -> user
+     * copy, and the kernel is told to read ahead with madvise.
+     */
+    class MmapInput {
+        static const int AVIO_BUFFER_SIZE = 256 * 1024;
+        static const size_t READ_AHEAD_SIZE = 16 * 1024 * 1024;
+
+        int fd = -1;
+        uint8_t* data = nullptr;
+        size_t size = 0;
+        size_t pos = 0;
+        size_t adviseEnd = 0;
+        AVIOContext* avioCtx = nullptr;
+        std::atomic<uint64_t> readCalls{0};
+
+        void adviseReadAhead() {
+            if (pos + READ_AHEAD_SIZE / 2 < adviseEnd) {
+                return;
+            }
+            long pageSize = sysconf(_SC_PAGESIZE);
+            size_t begin = pos - pos % pageSize;
+            size_t end = std::min(size, pos + READ_AHEAD_SIZE);
+            if (end > begin) {
+                madvise(data + begin, end - begin, MADV_WILLNEED);
+            }
+            adviseEnd = end;
+        }
+
+        static int readPacket(void* opaque, uint8_t* buf, int bufSize) {
+            auto self = (MmapInput*)opaque;
+            self->readCalls++;
+            if (self->pos >= self->size) {
+                return AVERROR_EOF;
+            }
+            int n = (int)std::min<size_t>(bufSize, self->size - self->pos);
+            std::memcpy(buf, self->data + self->pos, n);
+            self->pos += n;
+            self->adviseReadAhead();
+            return n;
+        }
+
+        static int64_t seek(void* opaque, int64_t offset, int whence) {
+            auto self = (MmapInput*)opaque;
+            int64_t target;
+            switch (whence & ~AVSEEK_FORCE) {
+                case AVSEEK_SIZE:
+                    return (int64_t)self->size;
+                case SEEK_SET:
+                    target = offset;
+                    break;
+                case SEEK_CUR:
+                    target = (int64_t)self->pos + offset;
+                    break;
+                case SEEK_END:
+                    target = (int64_t)self->size + offset;
+                    break;
+                default:
+                    return AVERROR(EINVAL);
+            }
+            if (target < 0 || target > (int64_t)self->size) {
+                return AVERROR(EINVAL);
+            }
+            self->pos = (size_t)target;
+            self->adviseEnd = 0;
+            self->adviseReadAhead();
+            return target;
+        }
+
+        void release() {
+            if (avioCtx != nullptr) {
+                av_freep(&avioCtx->buffer);
+                avio_context_free(&avioCtx);
+            }
+            if (data != nullptr) {
+                munmap(data, size);
+                data = nullptr;
+            }
+            if (fd >= 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+
+    public:
+        MmapInput(const MmapInput&) = delete;
+        MmapInput(MmapInput&&) noexcept = delete;
+        MmapInput operator=(const MmapInput&) = delete;
+
+        /*
+         * @return the file system path for plain paths and file: URLs, an empty string for
+         *         anything else (network protocols, pipes, devices ...).
+         */
+        static string localPath(const string& url) {
+            string path = url;
+            if (path.compare(0, 5, "file:") == 0) {
+                path = path.substr(5);
+            } else if (path.find("://") != string::npos) {
+                return "";
+            }
+            struct stat st {};
+            if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+                return "";
+            }
+            return path;
+        }
+
+        explicit MmapInput(const string& path) {
+            fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                throw std::runtime_error("MmapInput can not open file: " + path);
+            }
+
+            struct stat st {};
+            if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+                release();
+                throw std::runtime_error("MmapInput can not stat file: " + path);
+            }
+            size = (size_t)st.st_size;
+
+            void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                release();
+                throw std::runtime_error("MmapInput mmap failed: " + path);
+            }
+            data = (uint8_t*)p;
+            madvise(data, size, MADV_SEQUENTIAL);
+            adviseReadAhead();
+
+            auto buffer = (uint8_t*)av_malloc(AVIO_BUFFER_SIZE);
+            avioCtx = avio_alloc_context(buffer, AVIO_BUFFER_SIZE, 0, this, &MmapInput::readPacket,
+                                         nullptr, &MmapInput::seek);
+            if (avioCtx == nullptr) {
+                av_free(buffer);
+                release();
+                throw std::runtime_error("MmapInput avio_alloc_context failed: " + path);
+            }
+            cout << "mmap input: " << path << " size=" << size << endl;
+        }
+
+        ~MmapInput() { release(); }
+
+        AVIOContext* getAvioContext() const { return avioCtx; }
+
+        uint64_t getReadCalls() const { return readCalls.load(); }
+    };
+
+}  // namespace ffmpegUtil
@@ -0,0 +1,94 @@
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+};
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "SpscQueue.hpp"
+
+namespace ffmpegUtil {
+
+    /*
+     * Recycles AVPacket shells between the demux thread and the decoder threads.
+     *
+     * The demux thread acquires shells from a private free list. Each decoder thread hands used
+     * shells back through its own SPSC return queue, which the demux thread drains when its free
+     * list runs dry. Only a miss on both allocates, so after warm-up the packet path performs no
+     * shell allocations; getAllocations() counts the misses.
+     *
+     * Payload buffers are allocated by the demuxer inside av_read_frame and released by
+     * av_packet_unref; libavformat offers no hook to route them through a caller's pool.
+     */
+    class PacketPool {
+        static constexpr int RETURN_QUEUE_CAPACITY = 64;
+
+        std::vector<AVPacket*> freePackets{};  // demux thread only
+        std::vector<std::unique_ptr<SpscQueue<AVPacket*>>> returnQueues{};
+        std::atomic<uint64_t> allocations{0};
+        std::atomic<uint64_t> acquisitions{0};
+
+        void drainReturnQueues() {
+            AVPacket* pkt = nullptr;
+            for (auto& q : returnQueues) {
+                while (q->tryPop(pkt)) {
+                    freePackets.push_back(pkt);
+                }
+            }
+        }
+
+    public:
+        PacketPool() = default;
+        PacketPool(const PacketPool&) = delete;
+        PacketPool(PacketPool&&) noexcept = delete;
+        PacketPool operator=(const PacketPool&) = delete;
+
+        ~PacketPool() {
+            drainReturnQueues();
+            for (auto pkt : freePackets) {
+                av_packet_free(&pkt);
+            }
+        }
+
+        // registers a decoder thread, call before any packet flows.
+        int addConsumer() {
+            returnQueues.emplace_back(new SpscQueue<AVPacket*>(RETURN_QUEUE_CAPACITY));
+            return (int)returnQueues.size() - 1;
+        }
+
+        // demux thread.
+        AVPacket* acquire() {
+            acquisitions++;
+            if (freePackets.empty()) {
+                drainReturnQueues();
+            }
+            if (freePackets.empty()) {
+                allocations++;
+                return av_packet_alloc();
+            }
+            AVPacket* pkt = freePackets.back();
+            freePackets.pop_back();
+            return pkt;
+        }
+
+        // demux thread, for packets that were never handed to a decoder.
+        void recycle(AVPacket* pkt) {
+            av_packet_unref(pkt);
+            freePackets.push_back(pkt);
+        }
+
+        // decoder thread registered as consumer.
+        void release(int consumer, AVPacket* pkt) {
+            av_packet_unref(pkt);
+            if (!returnQueues[consumer]->tryPush(std::move(pkt))) {
+                av_packet_free(&pkt);
+            }
+        }
+
+        uint64_t getAllocations() const { return allocations.load(); }
+
+        uint64_t getAcquisitions() const { return acquisitions.load(); }
+    };
+
+}  // namespace ffmpegUtil
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include "SpscQueue.hpp"
+
+namespace ffmpegUtil {
+
+    /*
+     * Single-producer / single-consumer byte ring for interleaved PCM, between the audio decoder
+     * and the audio device callback.
+     *
+     * The consumer side never blocks, locks or allocates: read() copies whatever is there and
+     * fills the rest of the request with silence, counting the shortfall as an underrun. The
+     * producer tags the stream with presentation timestamps as it writes, so the consumer knows
+     * the pts of the byte it is about to play.
+     *
+     * Positions are byte counts since construction and never wrap in practice.
+     */
+    class PcmFifo {
+        static constexpr std::size_t CACHE_LINE = 64;
+        static constexpr std::size_t MARKS = 256;
+
+        // pts of the byte at position, in microseconds.
+        struct Mark {
+            uint64_t position = 0;
+            int64_t ptsUs = -1;
+        };
+
+        const std::size_t capacity;
+        const std::size_t mask;
+        std::unique_ptr<uint8_t[]> buffer;
+        SpscQueue<Mark> marks{MARKS};
+
+        alignas(CACHE_LINE) std::atomic<uint64_t> readPos{0};  // owned by the consumer
+        Mark currentMark{};
+        Mark nextMark{};
+        bool hasNextMark = false;
+
+        alignas(CACHE_LINE) std::atomic<uint64_t> writePos{0};  // owned by the producer
+        std::atomic<uint64_t> discardBefore{0};
+        std::atomic<bool> ended{false};
+
+        std::atomic<uint64_t> underruns{0};
+        std::atomic<uint64_t> underrunBytes{0};
+
+        static std::size_t roundUpPowerOfTwo(std::size_t n) {
+            std::size_t p = 1;
+            while (p < n) {
+                p <<= 1;
+            }
+            return p;
+        }
+
+        // consumer: advances to the last mark at or before position.
+        void updateMark(uint64_t position) {
+            while (true) {
+                if (!hasNextMark) {
+                    hasNextMark = marks.tryPop(nextMark);
+                    if (!hasNextMark) {
+                        return;
+                    }
+                }
+                if (nextMark.position > position) {
+                    return;
+                }
+                currentMark = nextMark;
+                hasNextMark = false;
+            }
+        }
+
+    public:
+        PcmFifo(const PcmFifo&) = delete;
+        PcmFifo(PcmFifo&&) noexcept = delete;
+        PcmFifo operator=(const PcmFifo&) = delete;
+
+        // C++14 operator new ignores the cache line alignment, keep it for heap allocated fifos.
+        static void* operator new(std::size_t size) {
+            void* p = nullptr;
+            if (posix_memalign(&p, CACHE_LINE, size) != 0) {
+                throw std::bad_alloc();
+            }
+            return p;
+        }
+
+        static void operator delete(void* p) { free(p); }
+
+        explicit PcmFifo(std::size_t minCapacity)
+                : capacity(roundUpPowerOfTwo(std::max<std::size_t>(minCapacity, 1))), mask(capacity - 1),
+                  buffer(new uint8_t[capacity]) {}
+
+        /*
+         * Producer: appends up to size bytes, ptsUs (if >= 0) is the pts of the first one.
+         * @return the bytes written, less than size if the fifo filled up.
+         */
+        std::size_t write(const uint8_t* data, std::size_t size, int64_t ptsUs = -1) {
+            uint64_t w = writePos.load(std::memory_order_relaxed);
+            uint64_t r = readPos.load(std::memory_order_acquire);
+            std::size_t n = std::min<std::size_t>(size, capacity - (std::size_t)(w - r));
+            if (n == 0) {
+                return 0;
+            }
+            if (ptsUs >= 0) {
+                Mark m{w, ptsUs};
+                marks.tryPush(std::move(m));  // a lost mark only makes the pts coarser
+            }
+            std::size_t offset = (std::size_t)(w & mask);
+            std::size_t first = std::min(n, capacity - offset);
+            std::memcpy(buffer.get() + offset, data, first);
+            std::memcpy(buffer.get(), data + first, n - first);
+            writePos.store(w + n, std::memory_order_release);
+            return n;
+        }
+
+        // producer: everything written so far is skipped instead of played, e.g. after a seek.
+        void discard() { discardBefore.store(writePos.load(std::memory_order_relaxed), std::memory_order_release); }
+
+        // producer: nothing more will be written, running dry from here on is the end, not an underrun.
+        void markEnd() { ended.store(true, std::memory_order_release); }
+
+        /*
+         * Consumer, wait-free: copies size bytes to out, silence where the fifo ran dry (an underrun
+         * once anything was written, until markEnd).
+         * @return the bytes that came from the fifo.
+         */
+        std::size_t read(uint8_t* out, std::size_t size) {
+            uint64_t r = readPos.load(std::memory_order_relaxed);
+            uint64_t skip = discardBefore.load(std::memory_order_acquire);
+            if (skip > r) {
+                r = skip;
+            }
+            uint64_t w = writePos.load(std::memory_order_acquire);
+            std::size_t n = std::min<std::size_t>(size, (std::size_t)(w - r));
+            std::size_t offset = (std::size_t)(r & mask);
+            std::size_t first = std::min(n, capacity - offset);
+            std::memcpy(out, buffer.get() + offset, first);
+            std::memcpy(out + first, buffer.get(), n - first);
+            if (n < size) {
+                std::memset(out + n, 0, size - n);
+            }
+            if (n < size && w > 0 && !ended.load(std::memory_order_acquire)) {
+                underruns.fetch_add(1, std::memory_order_relaxed);
+                underrunBytes.fetch_add(size - n, std::memory_order_relaxed);
+            }
+            readPos.store(r + n, std::memory_order_release);
+            return n;
+        }
+
+        /*
+         * Consumer: pts of the next byte to be read, bytesPerSecond the rate of the stream.
+         * @return -1 before the first timestamped byte.
+         */
+        int64_t getReadPtsUs(int bytesPerSecond) {
+            uint64_t r = std::max(readPos.load(std::memory_order_relaxed), discardBefore.load(std::memory_order_acquire));
+            updateMark(r);
+            if (currentMark.ptsUs < 0 || bytesPerSecond <= 0) {
+                return -1;
+            }
+            return currentMark.ptsUs + (int64_t)((r - currentMark.position) * 1000000 / bytesPerSecond);
+        }
+
+        // approximate when called concurrently.
+        std::size_t getFilledBytes() const {
+            uint64_t w = writePos.load(std::memory_order_acquire);
+            uint64_t r = std::max(readPos.load(std::memory_order_acquire), discardBefore.load(std::memory_order_acquire));
+            return w > r ? (std::size_t)(w - r) : 0;
+        }
+
+        std::size_t getFreeBytes() const { return capacity - getFilledBytes(); }
+
+        std::size_t getCapacity() const { return capacity; }
+
+        // reads that ran dry, and the bytes of silence they played.
+        uint64_t getUnderruns() const { return underruns.load(); }
+
+        uint64_t getUnderrunBytes() const { return underrunBytes.load(); }
+    };
+
+}  // namespace ffmpegUtil
@@ -0,0 +1,270 @@
+#pragma once
+
+extern "C" {
+#include <libavutil/frame.h>
+};
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PLAYER_X86_KERNELS 1
+#endif
+
+namespace ffmpegUtil {
+
+    // one implementation of the row kernels behind PixelKernels.
+    struct PixelKernelSet {
+        const char* name;
+        // n interleaved 8-bit UV pairs (NV12 chroma) into separate U and V rows.
+        void (*splitUV)(const uint8_t* src, uint8_t* u, uint8_t* v, int n);
+        // n 16-bit samples, shifted right by shift to 10 bits, dithered down to 8 bits.
+        // dither: offsets 0..3 for even and odd x.
+        void (*narrow)(const uint16_t* src, uint8_t* dst, int n, int shift, const uint8_t* dither);
+        // n interleaved 16-bit UV pairs (P010 chroma), split and narrowed like narrow().
+        void (*splitNarrowUV)(const uint16_t* src, uint8_t* u, uint8_t* v, int n, int shift,
+                              const uint8_t* dither);
+    };
+
+    /*
+     * Hand-written conversions to I420 (AV_PIX_FMT_YUV420P) for the source formats decoders hand
+     * out most: NV12, 10-bit YUV420P10 and P010 (ordered 2x2 dither), and I420 itself with other
+     * strides. Rows go through the widest kernel set the CPU runs, picked once at first use;
+     * the scalar set is the reference the others must match exactly.
+     *
+     * convert() works on a horizontal band starting at an even row, so it slots into SliceConverter.
+     */
+    class PixelKernels {
+        static uint8_t narrowOne(uint16_t s, int shift, uint8_t dither) {
+            return (uint8_t)std::min(255, std::min(65535, (s >> shift) + dither) >> 2);
+        }
+
+        static void splitUVScalar(const uint8_t* src, uint8_t* u, uint8_t* v, int n) {
+            for (int x = 0; x < n; x++) {
+                u[x] = src[2 * x];
+                v[x] = src[2 * x + 1];
+            }
+        }
+
+        static void narrowScalar(const uint16_t* src, uint8_t* dst, int n, int shift, const uint8_t* dither) {
+            for (int x = 0; x < n; x++) {
+                dst[x] = narrowOne(src[x], shift, dither[x & 1]);
+            }
+        }
+
+        static void splitNarrowUVScalar(const uint16_t* src, uint8_t* u, uint8_t* v, int n, int shift,
+                                        const uint8_t* dither) {
+            for (int x = 0; x < n; x++) {
+                u[x] = narrowOne(src[2 * x], shift, dither[x & 1]);
+                v[x] = narrowOne(src[2 * x + 1], shift, dither[x & 1]);
+            }
+        }
+
+#ifdef PLAYER_X86_KERNELS
+        // SSE2 and AVX2 loops leave the last n % step elements to the scalar kernels, from an even x.
+
+        __attribute__((target("sse2")))
+        static void splitUVSse2(const uint8_t* src, uint8_t* u, uint8_t* v, int n) {
+            const __m128i low = _mm_set1_epi16(0xff);
+            int x = 0;
+            for (; x + 16 <= n; x += 16) {
+                __m128i a = _mm_loadu_si128((const __m128i*)(src + 2 * x));
+                __m128i b = _mm_loadu_si128((const __m128i*)(src + 2 * x + 16));
+                _mm_storeu_si128((__m128i*)(u + x), _mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low)));
+                _mm_storeu_si128((__m128i*)(v + x), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+            }
+            splitUVScalar(src + 2 * x, u + x, v + x, n - x);
+        }
+
+        __attribute__((target("sse2")))
+        static void narrowSse2(const uint16_t* src, uint8_t* dst, int n, int shift, const uint8_t* dither) {
+            const __m128i d = _mm_set1_epi32(dither[0] | dither[1] << 16);
+            const __m128i s = _mm_cvtsi32_si128(shift);
+            int x = 0;
+            for (; x + 16 <= n; x += 16) {
+                __m128i a = _mm_loadu_si128((const __m128i*)(src + x));
+                __m128i b = _mm_loadu_si128((const __m128i*)(src + x + 8));
+                a = _mm_srli_epi16(_mm_adds_epu16(_mm_srl_epi16(a, s), d), 2);
+                b = _mm_srli_epi16(_mm_adds_epu16(_mm_srl_epi16(b, s), d), 2);
+                _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(a, b));
+            }
+            narrowScalar(src + x, dst + x, n - x, shift, dither);
+        }
+
+        __attribute__((target("sse2")))
+        static void splitNarrowUVSse2(const uint16_t* src, uint8_t* u, uint8_t* v, int n, int shift,
+                                      const uint8_t* dither) {
+            const __m128i d = _mm_set1_epi32(dither[0] | dither[1] << 16);
+            const __m128i s = _mm_cvtsi32_si128(shift);
+            const __m128i low = _mm_set1_epi32(0xffff);
+            int x = 0;
+            for (; x + 8 <= n; x += 8) {
+                __m128i a = _mm_srl_epi16(_mm_loadu_si128((const __m128i*)(src + 2 * x)), s);
+                __m128i b = _mm_srl_epi16(_mm_loadu_si128((const __m128i*)(src + 2 * x + 8)), s);
+                __m128i us = _mm_packs_epi32(_mm_and_si128(a, low), _mm_and_si128(b, low));
+                __m128i vs = _mm_packs_epi32(_mm_srli_epi32(a, 16), _mm_srli_epi32(b, 16));
+                us = _mm_srli_epi16(_mm_adds_epu16(us, d), 2);
+                vs = _mm_srli_epi16(_mm_adds_epu16(vs, d), 2);
+                __m128i uv = _mm_packus_epi16(us, vs);
+                _mm_storel_epi64((__m128i*)(u + x), uv);
+                _mm_storel_epi64((__m128i*)(v + x), _mm_srli_si128(uv, 8));
+            }
+            splitNarrowUVScalar(src + 2 * x, u + x, v + x, n - x, shift, dither);
+        }
+
+        // 256-bit packs work per 128-bit lane, the 0xD8 permute puts the quarters back in order.
+
+        __attribute__((target("avx2")))
+        static void splitUVAvx2(const uint8_t* src, uint8_t* u, uint8_t* v, int n) {
+            const __m256i low = _mm256_set1_epi16(0xff);
+            int x = 0;
+            for (; x + 32 <= n; x += 32) {
+                __m256i a = _mm256_loadu_si256((const __m256i*)(src + 2 * x));
+                __m256i b = _mm256_loadu_si256((const __m256i*)(src + 2 * x + 32));
+                __m256i us = _mm256_packus_epi16(_mm256_and_si256(a, low), _mm256_and_si256(b, low));
+                __m256i vs = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+                _mm256_storeu_si256((__m256i*)(u + x), _mm256_permute4x64_epi64(us, 0xD8));
+                _mm256_storeu_si256((__m256i*)(v + x), _mm256_permute4x64_epi64(vs, 0xD8));
+            }
+            splitUVSse2(src + 2 * x, u + x, v + x, n - x);
+        }
+
+        __attribute__((target("avx2")))
+        static void narrowAvx2(const uint16_t* src, uint8_t* dst, int n, int shift, const uint8_t* dither) {
+            const __m256i d = _mm256_set1_epi32(dither[0] | dither[1] << 16);
+            const __m128i s = _mm_cvtsi32_si128(shift);
+            int x = 0;
+            for (; x + 32 <= n; x += 32) {
+                __m256i a = _mm256_loadu_si256((const __m256i*)(src + x));
+                __m256i b = _mm256_loadu_si256((const __m256i*)(src + x + 16));
+                a = _mm256_srli_epi16(_mm256_adds_epu16(_mm256_srl_epi16(a, s), d), 2);
+                b = _mm256_srli_epi16(_mm256_adds_epu16(_mm256_srl_epi16(b, s), d), 2);
+                _mm256_storeu_si256((__m256i*)(dst + x), _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8));
+            }
+            narrowSse2(src + x, dst + x, n - x, shift, dither);
+        }
+
+        __attribute__((target("avx2")))
+        static void splitNarrowUVAvx2(const uint16_t* src, uint8_t* u, uint8_t* v, int n, int shift,
+                                      const uint8_t* dither) {
+            const __m256i d = _mm256_set1_epi32(dither[0] | dither[1] << 16);
+            const __m128i s = _mm_cvtsi32_si128(shift);
+            const __m256i low = _mm256_set1_epi32(0xffff);
+            int x = 0;
+            for (; x + 16 <= n; x += 16) {
+                __m256i a = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i*)(src + 2 * x)), s);
+                __m256i b = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i*)(src + 2 * x + 16)), s);
+                __m256i us = _mm256_permute4x64_epi64(
+                        _mm256_packs_epi32(_mm256_and_si256(a, low), _mm256_and_si256(b, low)), 0xD8);
+                __m256i vs = _mm256_permute4x64_epi64(
+                        _mm256_packs_epi32(_mm256_srli_epi32(a, 16), _mm256_srli_epi32(b, 16)), 0xD8);
+                us = _mm256_srli_epi16(_mm256_adds_epu16(us, d), 2);
+                vs = _mm256_srli_epi16(_mm256_adds_epu16(vs, d), 2);
+                __m256i uv = _mm256_permute4x64_epi64(_mm256_packus_epi16(us, vs), 0xD8);
+                _mm_storeu_si128((__m128i*)(u + x), _mm256_castsi256_si128(uv));
+                _mm_storeu_si128((__m128i*)(v + x), _mm256_extracti128_si256(uv, 1));
+            }
+            splitNarrowUVSse2(src + 2 * x, u + x, v + x, n - x, shift, dither);
+        }
+#endif
+
+        static const uint8_t* ditherRow(int y) {
+            static const uint8_t dither[2][2] = {{0, 2}, {3, 1}};
+            return dither[y & 1];
+        }
+
+        static void copyPlane(const AVFrame* src, AVFrame* dst, int plane, int y, int rows, int rowBytes) {
+            const uint8_t* in = src->data[plane] + y * src->linesize[plane];
+            uint8_t* out = dst->data[plane] + y * dst->linesize[plane];
+            if (src->linesize[plane] == rowBytes && dst->linesize[plane] == rowBytes) {
+                std::memcpy(out, in, (size_t)rowBytes * rows);
+                return;
+            }
+            for (int r = 0; r < rows; r++) {
+                std::memcpy(out + r * dst->linesize[plane], in + r * src->linesize[plane], rowBytes);
+            }
+        }
+
+        static void narrowPlane(const PixelKernelSet& k, const AVFrame* src, AVFrame* dst, int plane, int y,
+                                int rows, int width, int shift) {
+            for (int r = y; r < y + rows; r++) {
+                k.narrow((const uint16_t*)(src->data[plane] + r * src->linesize[plane]),
+                         dst->data[plane] + r * dst->linesize[plane], width, shift, ditherRow(r));
+            }
+        }
+
+    public:
+        static const PixelKernelSet& scalar() {
+            static const PixelKernelSet set{"scalar", splitUVScalar, narrowScalar, splitNarrowUVScalar};
+            return set;
+        }
+
+        // every kernel set this CPU runs, scalar first.
+        static std::vector<const PixelKernelSet*> supported() {
+            std::vector<const PixelKernelSet*> sets{&scalar()};
+#ifdef PLAYER_X86_KERNELS
+            static const PixelKernelSet sse2{"sse2", splitUVSse2, narrowSse2, splitNarrowUVSse2};
+            static const PixelKernelSet avx2{"avx2", splitUVAvx2, narrowAvx2, splitNarrowUVAvx2};
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("sse2")) {
+                sets.push_back(&sse2);
+                if (__builtin_cpu_supports("avx2")) {
+                    sets.push_back(&avx2);
+                }
+            }
+#endif
+            return sets;
+        }
+
+        static const PixelKernelSet& best() {
+            static const PixelKernelSet* set = supported().back();
+            return *set;
+        }
+
+        static bool supports(int srcFormat, int dstFormat) {
+            return dstFormat == AV_PIX_FMT_YUV420P &&
+                   (srcFormat == AV_PIX_FMT_YUV420P || srcFormat == AV_PIX_FMT_NV12 ||
+                    srcFormat == AV_PIX_FMT_YUV420P10LE || srcFormat == AV_PIX_FMT_P010LE);
+        }
+
+        // converts rows [y, y + rows) of src into dst, y even. dst has src's size.
+        static void convert(const PixelKernelSet& k, const AVFrame* src, AVFrame* dst, int y, int rows) {
+            int width = src->width;
+            int chromaWidth = (width + 1) / 2;
+            int chromaY = y / 2;
+            int chromaRows = (y + rows + 1) / 2 - chromaY;
+            switch (src->format) {
+                case AV_PIX_FMT_YUV420P:
+                    copyPlane(src, dst, 0, y, rows, width);
+                    copyPlane(src, dst, 1, chromaY, chromaRows, chromaWidth);
+                    copyPlane(src, dst, 2, chromaY, chromaRows, chromaWidth);
+                    break;
+                case AV_PIX_FMT_NV12:
+                    copyPlane(src, dst, 0, y, rows, width);
+                    for (int r = chromaY; r < chromaY + chromaRows; r++) {
+                        k.splitUV(src->data[1] + r * src->linesize[1], dst->data[1] + r * dst->linesize[1],
+                                  dst->data[2] + r * dst->linesize[2], chromaWidth);
+                    }
+                    break;
+                case AV_PIX_FMT_YUV420P10LE:
+                    narrowPlane(k, src, dst, 0, y, rows, width, 0);
+                    narrowPlane(k, src, dst, 1, chromaY, chromaRows, chromaWidth, 0);
+                    narrowPlane(k, src, dst, 2, chromaY, chromaRows, chromaWidth, 0);
+                    break;
+                case AV_PIX_FMT_P010LE:
+                    narrowPlane(k, src, dst, 0, y, rows, width, 6);
+                    for (int r = chromaY; r < chromaY + chromaRows; r++) {
+                        k.splitNarrowUV((const uint16_t*)(src->data[1] + r * src->linesize[1]),
+                                        dst->data[1] + r * dst->linesize[1], dst->data[2] + r * dst->linesize[2],
+                                        chromaWidth, 6, ditherRow(r));
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    };
+
+}  // namespace ffmpegUtil
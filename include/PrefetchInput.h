@@ -0,0 +1,376 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avformat.h>
+};
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef PLAYER_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+namespace ffmpegUtil {
+
+    using std::cout;
+    using std::endl;
+    using std::string;
+
+    /*
+     * AVIOContext that reads from a window of blocks kept resident ahead of the demux position by
+     * a dedicated io thread.
+     *
+     * The io thread issues large, block aligned reads: batched through io_uring when built with
+     * PLAYER_HAVE_LIBURING, plain pread otherwise. The demuxer only waits when the block it needs
+     * is not loaded yet, and that wait is accounted as stall time.
+     */
+    class PrefetchInput {
+        static const int AVIO_BUFFER_SIZE = 256 * 1024;
+        static const size_t BLOCK_SIZE = 1024 * 1024;
+        static const size_t ALIGNMENT = 4096;
+        static const int QUEUE_DEPTH = 8;
+
+        struct Block {
+            uint8_t* data = nullptr;
+            int64_t index = -1;
+            size_t length = 0;
+            bool ready = false;
+        };
+
+        int fd = -1;
+        int64_t size = 0;
+        int64_t lastBlock = -1;
+        std::vector<Block> blocks{};
+        AVIOContext* avioCtx = nullptr;
+
+        // demux side, only touched by the thread running av_read_frame.
+        int64_t pos = 0;
+
+        std::mutex blockMutex{};
+        std::condition_variable blockCv{};
+        int64_t readBlock = 0;     // block holding pos, guarded by blockMutex
+        size_t windowBlocks = 0;   // active window, <= blocks.size(), guarded by blockMutex
+        bool stopped = false;      // guarded by blockMutex
+        std::thread ioThread{};
+
+        std::atomic<uint64_t> stallNanos{0};
+        std::atomic<uint64_t> stallCount{0};
+        std::atomic<uint64_t> bytesLoaded{0};
+
+#ifdef PLAYER_HAVE_LIBURING
+        struct io_uring ring {};
+        std::atomic<bool> uringReady{false};  // cleared by the io thread if the ring fails
+#endif
+
+        Block& slotOf(int64_t blockIndex) { return blocks[blockIndex % blocks.size()]; }
+
+        size_t blockLength(int64_t blockIndex) const {
+            return (size_t)std::min<int64_t>(BLOCK_SIZE, size - blockIndex * (int64_t)BLOCK_SIZE);
+        }
+
+        bool preadFully(uint8_t* dst, size_t length, int64_t offset, size_t done = 0) {
+            while (done < length) {
+                ssize_t n = pread(fd, dst + done, length - done, offset + done);
+                if (n <= 0) {
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+                done += n;
+            }
+            return true;
+        }
+
+        // fills every block in pending with its data, returns the ones that were read completely.
+        std::vector<Block*> loadBlocks(const std::vector<Block*>& pending) {
+            std::vector<Block*> loaded{};
+#ifdef PLAYER_HAVE_LIBURING
+            if (uringReady) {
+                for (auto b : pending) {
+                    struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+                    io_uring_prep_read(sqe, fd, b->data, b->length, b->index * (int64_t)BLOCK_SIZE);
+                    io_uring_sqe_set_data(sqe, b);
+                }
+                // a submitted read owns its block until its completion is reaped, whatever else fails.
+                size_t inFlight = 0;
+                while (inFlight < pending.size()) {
+                    int ret = io_uring_submit(&ring);
+                    if (ret > 0) {
+                        inFlight += ret;
+                    } else if (ret != -EINTR && ret != -EAGAIN) {
+                        break;
+                    }
+                }
+                size_t completed = 0;
+                while (completed < inFlight) {
+                    struct io_uring_cqe* cqe = nullptr;
+                    int ret = io_uring_wait_cqe(&ring, &cqe);
+                    if (ret == -EINTR || ret == -EAGAIN) {
+                        continue;
+                    }
+                    if (ret != 0) {
+                        break;
+                    }
+                    completed++;
+                    auto b = (Block*)io_uring_cqe_get_data(cqe);
+                    int res = cqe->res;
+                    io_uring_cqe_seen(&ring, cqe);
+                    if (res == -EINTR || res == -EAGAIN) {
+                        res = 0;
+                    }
+                    // short reads are finished synchronously.
+                    if (res >= 0 && preadFully(b->data, b->length, b->index * (int64_t)BLOCK_SIZE, res)) {
+                        loaded.push_back(b);
+                    }
+                }
+                if (completed == pending.size()) {
+                    return loaded;
+                }
+                // the ring itself failed: tearing it down cancels or waits out what is still in
+                // flight, everything from here on is read with pread.
+                cout << "prefetch input: io_uring failed, falling back to pread" << endl;
+                io_uring_queue_exit(&ring);
+                uringReady = false;
+                for (auto b : pending) {
+                    if (std::find(loaded.begin(), loaded.end(), b) == loaded.end() &&
+                        preadFully(b->data, b->length, b->index * (int64_t)BLOCK_SIZE)) {
+                        loaded.push_back(b);
+                    }
+                }
+                return loaded;
+            }
+#endif
+            for (auto b : pending) {
+                if (preadFully(b->data, b->length, b->index * (int64_t)BLOCK_SIZE)) {
+                    loaded.push_back(b);
+                }
+            }
+            return loaded;
+        }
+
+        void ioLoop() {
+            std::unique_lock<std::mutex> lk{blockMutex};
+            while (!stopped) {
+                std::vector<Block*> pending{};
+                int64_t end = std::min<int64_t>(lastBlock, readBlock + (int64_t)windowBlocks - 1);
+                for (int64_t i = readBlock; i <= end && (int)pending.size() < QUEUE_DEPTH; i++) {
+                    Block& b = slotOf(i);
+                    if (b.index != i) {
+                        b.index = i;
+                        b.length = blockLength(i);
+                        b.ready = false;
+                        pending.push_back(&b);
+                    }
+                }
+                if (pending.empty()) {
+                    blockCv.wait(lk);
+                    continue;
+                }
+
+                lk.unlock();
+                auto loaded = loadBlocks(pending);
+                lk.lock();
+
+                for (auto b : loaded) {
+                    b->ready = true;
+                    bytesLoaded += b->length;
+                }
+                if (loaded.size() != pending.size()) {
+                    // io error: give the demuxer an error instead of waiting forever. readPacket drops
+                    // the block once it reported it, so the next access reads it again.
+                    for (auto b : pending) {
+                        if (!b->ready) {
+                            b->length = 0;
+                            b->ready = true;
+                        }
+                    }
+                }
+                blockCv.notify_all();
+            }
+        }
+
+        static int readPacket(void* opaque, uint8_t* buf, int bufSize) {
+            auto self = (PrefetchInput*)opaque;
+            if (self->pos >= self->size) {
+                return AVERROR_EOF;
+            }
+            int64_t blockIndex = self->pos / BLOCK_SIZE;
+            Block& b = self->slotOf(blockIndex);
+            {
+                std::unique_lock<std::mutex> lk{self->blockMutex};
+                if (self->readBlock != blockIndex) {
+                    self->readBlock = blockIndex;
+                    self->blockCv.notify_all();
+                }
+                if (b.index != blockIndex || !b.ready) {
+                    auto stallBegin = std::chrono::steady_clock::now();
+                    self->blockCv.wait(lk, [&] { return b.index == blockIndex && b.ready; });
+                    self->stallNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - stallBegin).count();
+                    self->stallCount++;
+                }
+                if (b.length == 0) {
+                    b.index = -1;
+                    self->blockCv.notify_all();
+                    return AVERROR(EIO);
+                }
+            }
+            // the io thread never reuses the slot of readBlock, so the copy needs no lock.
+            size_t offset = self->pos - blockIndex * (int64_t)BLOCK_SIZE;
+            if (offset >= b.length) {
+                return AVERROR(EIO);
+            }
+            int n = (int)std::min<size_t>(bufSize, b.length - offset);
+            std::memcpy(buf, b.data + offset, n);
+            self->pos += n;
+            return n;
+        }
+
+        static int64_t seek(void* opaque, int64_t offset, int whence) {
+            auto self = (PrefetchInput*)opaque;
+            int64_t target;
+            switch (whence & ~AVSEEK_FORCE) {
+                case AVSEEK_SIZE:
+                    return self->size;
+                case SEEK_SET:
+                    target = offset;
+                    break;
+                case SEEK_CUR:
+                    target = self->pos + offset;
+                    break;
+                case SEEK_END:
+                    target = self->size + offset;
+                    break;
+                default:
+                    return AVERROR(EINVAL);
+            }
+            if (target < 0 || target > self->size) {
+                return AVERROR(EINVAL);
+            }
+            self->pos = target;
+            return target;
+        }
+
+        void release() {
+            if (ioThread.joinable()) {
+                {
+                    std::lock_guard<std::mutex> lg(blockMutex);
+                    stopped = true;
+                }
+                blockCv.notify_all();
+                ioThread.join();
+            }
+#ifdef PLAYER_HAVE_LIBURING
+            if (uringReady) {
+                io_uring_queue_exit(&ring);
+                uringReady = false;
+            }
+#endif
+            if (avioCtx != nullptr) {
+                av_freep(&avioCtx->buffer);
+                avio_context_free(&avioCtx);
+            }
+            for (auto& b : blocks) {
+                free(b.data);
+                b.data = nullptr;
+            }
+            if (fd >= 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+
+    public:
+        PrefetchInput(const PrefetchInput&) = delete;
+        PrefetchInput(PrefetchInput&&) noexcept = delete;
+        PrefetchInput operator=(const PrefetchInput&) = delete;
+
+        /*
+         * @param windowMB memory reserved for read-ahead, also the largest window that
+         *                 setWindowBytes can select later.
+         */
+        PrefetchInput(const string& path, int windowMB) {
+            fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                throw std::runtime_error("PrefetchInput can not open file: " + path);
+            }
+            struct stat st {};
+            if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+                release();
+                throw std::runtime_error("PrefetchInput can not stat file: " + path);
+            }
+            size = st.st_size;
+            lastBlock = (size - 1) / (int64_t)BLOCK_SIZE;
+
+            size_t n = std::max<size_t>(2, (size_t)windowMB * 1024 * 1024 / BLOCK_SIZE);
+            blocks.resize(n);
+            for (auto& b : blocks) {
+                if (posix_memalign((void**)&b.data, ALIGNMENT, BLOCK_SIZE) != 0) {
+                    b.data = nullptr;
+                    release();
+                    throw std::runtime_error("PrefetchInput can not allocate read-ahead window.");
+                }
+            }
+            windowBlocks = n;
+
+#ifdef PLAYER_HAVE_LIBURING
+            uringReady = io_uring_queue_init(QUEUE_DEPTH, &ring, 0) == 0;
+#endif
+
+            auto buffer = (uint8_t*)av_malloc(AVIO_BUFFER_SIZE);
+            avioCtx = avio_alloc_context(buffer, AVIO_BUFFER_SIZE, 0, this, &PrefetchInput::readPacket,
+                                         nullptr, &PrefetchInput::seek);
+            if (avioCtx == nullptr) {
+                av_free(buffer);
+                release();
+                throw std::runtime_error("PrefetchInput avio_alloc_context failed: " + path);
+            }
+
+            ioThread = std::thread{&PrefetchInput::ioLoop, this};
+            cout << "prefetch input: " << path << " window=" << n << "MB io=" << getIoBackend() << endl;
+        }
+
+        ~PrefetchInput() { release(); }
+
+        // shrinks (or restores) the active window, bounded by the memory reserved at construction.
+        void setWindowBytes(int64_t bytes) {
+            size_t n = (size_t)std::max<int64_t>(1, (bytes + BLOCK_SIZE - 1) / (int64_t)BLOCK_SIZE);
+            {
+                std::lock_guard<std::mutex> lg(blockMutex);
+                windowBlocks = std::min(n, blocks.size());
+            }
+            blockCv.notify_all();
+        }
+
+        AVIOContext* getAvioContext() const { return avioCtx; }
+
+        const char* getIoBackend() const {
+#ifdef PLAYER_HAVE_LIBURING
+            if (uringReady) {
+                return "io_uring";
+            }
+#endif
+            return "pread";
+        }
+
+        double getStallMs() const { return stallNanos.load() / 1e6; }
+
+        uint64_t getStallCount() const { return stallCount.load(); }
+
+        uint64_t getBytesLoaded() const { return bytesLoaded.load(); }
+    };
+
+}  // namespace ffmpegUtil
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include "Logger.h"
+
+namespace ffmpegUtil {
+
+    /*
+     * Picks how much decode work video may skip, from how late it is against the master clock.
+     *
+     * Sustained lateness escalates one level at a time; each level gets a few reports to take
+     * effect before the next one. Once video stays in time for a while it steps back down, again
+     * one level at a time. Reports come from the presenting thread, the level is read by the decoder.
+     */
+    class QualityController {
+    public:
+        enum Level { FULL, SKIP_LOOP_FILTER, SKIP_NONREF, DROP_LATE };
+
+    private:
+        static const int LATE_MS = 60;
+        static const int IN_TIME_MS = 15;
+        static const int ESCALATE_AFTER = 8;
+        static const int RECOVER_AFTER = 60;
+
+        std::atomic<int> level{FULL};
+        int lateReports = 0;
+        int inTimeReports = 0;
+
+        std::atomic<uint64_t> escalations{0};
+        std::atomic<uint64_t> recoveries{0};
+
+        static const char* name(int l) {
+            switch (l) {
+                case SKIP_LOOP_FILTER:
+                    return "skip loop filter";
+                case SKIP_NONREF:
+                    return "skip non-ref frames";
+                case DROP_LATE:
+                    return "drop late frames";
+                default:
+                    return "full";
+            }
+        }
+
+    public:
+        // lateMs: how far video is behind the master clock, negative when ahead.
+        // @return true if the level changed.
+        bool report(int64_t lateMs) {
+            int l = level.load();
+            if (lateMs > LATE_MS) {
+                inTimeReports = 0;
+                if (++lateReports >= ESCALATE_AFTER && l < DROP_LATE) {
+                    lateReports = 0;
+                    level.store(l + 1);
+                    escalations++;
+                    LOG_INFO("video late " << lateMs << "ms, decode quality -> " << name(l + 1)
+                             << " (escalations=" << escalations.load() << ")");
+                    return true;
+                }
+            } else if (lateMs < IN_TIME_MS) {
+                lateReports = 0;
+                if (++inTimeReports >= RECOVER_AFTER && l > FULL) {
+                    inTimeReports = 0;
+                    level.store(l - 1);
+                    recoveries++;
+                    LOG_INFO("video in time, decode quality -> " << name(l - 1)
+                             << " (recoveries=" << recoveries.load() << ")");
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        Level getLevel() const { return (Level)level.load(); }
+
+        uint64_t getEscalations() const { return escalations.load(); }
+
+        uint64_t getRecoveries() const { return recoveries.load(); }
+    };
+
+}  // namespace ffmpegUtil
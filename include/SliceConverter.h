@@ -0,0 +1,226 @@
+#pragma once
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+};
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include "PixelKernels.h"
+#include "TaskScheduler.h"
+#include "Logger.h"
+
+namespace ffmpegUtil {
+
+    /*
+     * Same-size pixel format conversion split into horizontal slices that run on a TaskScheduler.
+     *
+     * Every slice has its own SwsContext sized to its band, so slices share no scaler state. The
+     * calling thread converts slices too and only waits for the ones other workers already took,
+     * so converting from inside a scheduler task can not deadlock. convert() returns when the
+     * whole frame is done. Frames too small to be worth splitting take a single slice.
+     * Format pairs PixelKernels handles skip swscale and run those kernels on each slice.
+     */
+    class SliceConverter {
+        static const int MIN_SLICE_ROWS = 256;
+        static const int SLICE_ALIGN = 16;  // keeps every band boundary on a chroma row
+
+        struct Slice {
+            SwsContext* ctx;  // nullptr when kernels convert the slice
+            int y;
+            int h;
+        };
+
+        struct Layout {
+            int planes = 0;
+            int shift[4] = {0, 0, 0, 0};  // log2 of the vertical subsampling of each plane
+        };
+
+        // one convert() call, kept alive by the helper tasks that may start after it returned.
+        struct Job {
+            const Slice* slices;
+            int count;
+            const PixelKernelSet* kernels;
+            const Layout* srcLayout;
+            const Layout* dstLayout;
+            const AVFrame* src;
+            AVFrame* dst;
+            std::atomic<int> next{0};
+            std::atomic<int> done{0};
+            std::mutex doneMutex{};
+            std::condition_variable doneCv{};
+
+            void work() {
+                int i;
+                while ((i = next++) < count) {
+                    if (kernels != nullptr) {
+                        PixelKernels::convert(*kernels, src, dst, slices[i].y, slices[i].h);
+                    } else {
+                        convertSlice(slices[i], *srcLayout, *dstLayout, src, dst);
+                    }
+                    if (++done == count) {
+                        std::lock_guard<std::mutex> lg(doneMutex);
+                        doneCv.notify_all();
+                    }
+                }
+            }
+
+            void wait() {
+                std::unique_lock<std::mutex> lk{doneMutex};
+                doneCv.wait(lk, [this] { return done.load() == count; });
+            }
+        };
+
+        TaskScheduler* scheduler;
+        int maxSlices;
+        std::vector<Slice> slices{};
+        const PixelKernelSet* kernels = nullptr;
+        Layout srcLayout{};
+        Layout dstLayout{};
+        int srcFormat = AV_PIX_FMT_NONE;
+        int dstFormat = AV_PIX_FMT_NONE;
+        int width = 0;
+        int height = 0;
+
+        std::atomic<int> sliceCount{0};
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> busyNanos{0};
+
+        static Layout layoutOf(AVPixelFormat f) {
+            Layout l{};
+            const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(f);
+            l.planes = std::min(4, std::max(0, av_pix_fmt_count_planes(f)));
+            if (desc == nullptr) {
+                return l;
+            }
+            for (int c = 1; c < 3 && c < desc->nb_components; c++) {
+                int p = desc->comp[c].plane;
+                if (p != desc->comp[0].plane) {
+                    l.shift[p] = desc->log2_chroma_h;
+                }
+            }
+            return l;
+        }
+
+        static void convertSlice(const Slice& s, const Layout& srcLayout, const Layout& dstLayout,
+                                 const AVFrame* src, AVFrame* dst) {
+            const uint8_t* in[4];
+            uint8_t* out[4];
+            for (int p = 0; p < 4; p++) {
+                in[p] = src->data[p];
+                out[p] = dst->data[p];
+                if (p < srcLayout.planes) {
+                    in[p] += (s.y >> srcLayout.shift[p]) * src->linesize[p];
+                }
+                if (p < dstLayout.planes) {
+                    out[p] += (s.y >> dstLayout.shift[p]) * dst->linesize[p];
+                }
+            }
+            sws_scale(s.ctx, in, src->linesize, 0, s.h, out, dst->linesize);
+        }
+
+        void freeSlices() {
+            for (auto& s : slices) {
+                if (s.ctx != nullptr) {
+                    sws_freeContext(s.ctx);
+                }
+            }
+            slices.clear();
+        }
+
+        void prepare(const AVFrame* src, int target) {
+            if (!slices.empty() && srcFormat == src->format && dstFormat == target && width == src->width &&
+                height == src->height) {
+                return;
+            }
+            freeSlices();
+            srcFormat = src->format;
+            dstFormat = target;
+            width = src->width;
+            height = src->height;
+            srcLayout = layoutOf((AVPixelFormat)srcFormat);
+            dstLayout = layoutOf((AVPixelFormat)dstFormat);
+            kernels = PixelKernels::supports(srcFormat, dstFormat) ? &PixelKernels::best() : nullptr;
+
+            int n = std::max(1, std::min(maxSlices, height / MIN_SLICE_ROWS));
+            int rows = (height + n - 1) / n;
+            rows = (rows + SLICE_ALIGN - 1) / SLICE_ALIGN * SLICE_ALIGN;
+            for (int y = 0; y < height; y += rows) {
+                int h = std::min(rows, height - y);
+                if (kernels != nullptr) {
+                    slices.push_back(Slice{nullptr, y, h});
+                    continue;
+                }
+                SwsContext* ctx = sws_getContext(width, h, (AVPixelFormat)srcFormat, width, h,
+                                                 (AVPixelFormat)dstFormat, SWS_BILINEAR, NULL, NULL, NULL);
+                if (ctx == nullptr) {
+                    freeSlices();
+                    throw std::runtime_error("can not create slice scaler.");
+                }
+                slices.push_back(Slice{ctx, y, h});
+            }
+            sliceCount.store((int)slices.size());
+            LOG_INFO("colour conversion " << av_get_pix_fmt_name((AVPixelFormat)srcFormat) << " -> "
+                     << av_get_pix_fmt_name((AVPixelFormat)dstFormat) << " " << width << "x" << height << " in "
+                     << slices.size() << " slices, " << (kernels != nullptr ? kernels->name : "swscale"));
+        }
+
+    public:
+        SliceConverter(const SliceConverter&) = delete;
+        SliceConverter(SliceConverter&&) noexcept = delete;
+        SliceConverter operator=(const SliceConverter&) = delete;
+
+        // maxSlices 0: up to one slice per scheduler worker. without a scheduler the calling thread
+        // converts every slice.
+        explicit SliceConverter(TaskScheduler* s = &TaskScheduler::shared(), int maxSlices = 0)
+                : scheduler(s), maxSlices(maxSlices > 0 ? maxSlices : s != nullptr ? s->getWorkerCount() : 1) {}
+
+        ~SliceConverter() { freeSlices(); }
+
+        // not while convert() runs. the next frame plans its slices for s.
+        void setScheduler(TaskScheduler* s, int slices = 0) {
+            scheduler = s;
+            maxSlices = slices > 0 ? slices : s != nullptr ? s->getWorkerCount() : 1;
+            freeSlices();
+        }
+
+        // converts src into dst, which has src's size and an allocated buffer in the target format.
+        void convert(const AVFrame* src, AVFrame* dst) {
+            auto begin = std::chrono::steady_clock::now();
+            prepare(src, dst->format);
+            auto job = std::make_shared<Job>();
+            job->slices = slices.data();
+            job->count = (int)slices.size();
+            job->kernels = kernels;
+            job->srcLayout = &srcLayout;
+            job->dstLayout = &dstLayout;
+            job->src = src;
+            job->dst = dst;
+            for (int i = 1; i < job->count && scheduler != nullptr; i++) {
+                scheduler->submit([job] { job->work(); });
+            }
+            job->work();
+            job->wait();
+            frames++;
+            busyNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - begin).count();
+        }
+
+        int getSliceCount() const { return sliceCount.load(); }
+
+        int getMaxSlices() const { return maxSlices; }
+
+        uint64_t getFrames() const { return frames.load(); }
+
+        // wall time of convert() per frame, waiting for the slices included.
+        double getMsPerFrame() const { return frames.load() == 0 ? 0 : busyNanos.load() / 1e6 / frames.load(); }
+    };
+
+}  // namespace ffmpegUtil
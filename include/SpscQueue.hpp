@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+namespace ffmpegUtil {
+
+    /*
+     * Bounded single-producer / single-consumer ring buffer.
+     *
+     * Exactly one thread may call tryPush and exactly one (other) thread may call tryPop.
+     * The consumer's head and the producer's tail live on separate cache lines, each next to a
+     * cached copy of the other side's index, so the shared atomics are only read when that copy
+     * is stale.
+     */
+    template <typename T>
+    class SpscQueue {
+        static constexpr std::size_t CACHE_LINE = 64;
+
+        const std::size_t capacity;
+        const std::size_t mask;
+        std::unique_ptr<T[]> slots;
+
+        alignas(CACHE_LINE) std::atomic<std::size_t> head{0};  // next slot to pop, owned by consumer
+        std::size_t cachedTail = 0;                            // consumer's view of tail
+
+        alignas(CACHE_LINE) std::atomic<std::size_t> tail{0};  // next slot to push, owned by producer
+        std::size_t cachedHead = 0;                            // producer's view of head
+
+        static std::size_t roundUpPowerOfTwo(std::size_t n) {
+            std::size_t p = 1;
+            while (p < n) {
+                p <<= 1;
+            }
+            return p;
+        }
+
+    public:
+        SpscQueue(const SpscQueue&) = delete;
+        SpscQueue(SpscQueue&&) noexcept = delete;
+        SpscQueue operator=(const SpscQueue&) = delete;
+
+        // C++14 operator new ignores the cache line alignment, keep it for heap allocated queues.
+        static void* operator new(std::size_t size) {
+            void* p = nullptr;
+            if (posix_memalign(&p, CACHE_LINE, size) != 0) {
+                throw std::bad_alloc();
+            }
+            return p;
+        }
+
+        static void operator delete(void* p) { free(p); }
+
+        explicit SpscQueue(std::size_t minCapacity)
+                : capacity(roundUpPowerOfTwo(minCapacity)), mask(capacity - 1),
+                  slots(new T[capacity]) {
+            if (minCapacity == 0) {
+                throw std::runtime_error("SpscQueue capacity must be positive.");
+            }
+        }
+
+        bool tryPush(T&& v) {
+            const auto t = tail.load(std::memory_order_relaxed);
+            if (t - cachedHead == capacity) {
+                cachedHead = head.load(std::memory_order_acquire);
+                if (t - cachedHead == capacity) {
+                    return false;
+                }
+            }
+            slots[t & mask] = std::move(v);
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool tryPop(T& v) {
+            const auto h = head.load(std::memory_order_relaxed);
+            if (h == cachedTail) {
+                cachedTail = tail.load(std::memory_order_acquire);
+                if (h == cachedTail) {
+                    return false;
+                }
+            }
+            v = std::move(slots[h & mask]);
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        // approximate when called concurrently, exact from either side when the other is idle.
+        std::size_t size() const {
+            // head first: tail can only have moved on since, so t - h does not wrap.
+            const auto h = head.load(std::memory_order_acquire);
+            const auto t = tail.load(std::memory_order_acquire);
+            if (t <= h) {
+                return 0;
+            }
+            return t - h < capacity ? t - h : capacity;
+        }
+
+        bool empty() const { return size() == 0; }
+
+        std::size_t getCapacity() const { return capacity; }
+    };
+
+}  // namespace ffmpegUtil
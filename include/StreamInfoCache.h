@@ -0,0 +1,290 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avformat.h>
+};
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ffmpegUtil {
+
+    using std::cout;
+    using std::endl;
+    using std::string;
+
+    /*
+     * Persists what avformat_find_stream_info learned about a local file, so that opening the
+     * same file again can skip probing.
+     *
+     * One text file per media file lives in $XDG_CACHE_HOME/player (or ~/.cache/player). It is
+     * keyed by path, size and mtime; any mismatch with the file or with the streams the
+     * demuxer found in the header makes the entry invalid and the caller probes as usual.
+     */
+    class StreamInfoCache {
+        static const int VERSION = 1;
+
+    public:
+        struct FileIdentity {
+            string path;
+            int64_t size = -1;
+            int64_t mtime = -1;
+        };
+
+        // false for anything but a regular local file.
+        static bool identify(const string& url, FileIdentity& id) {
+            string path = url.compare(0, 5, "file:") == 0 ? url.substr(5) : url;
+            struct stat st {};
+            if (path.find("://") != string::npos || stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+                return false;
+            }
+            id.path = path;
+            id.size = st.st_size;
+            id.mtime = st.st_mtime;
+            return true;
+        }
+
+        static string cacheDir() {
+            const char* xdg = getenv("XDG_CACHE_HOME");
+            const char* home = getenv("HOME");
+            string base = xdg != nullptr && *xdg ? xdg : string(home != nullptr ? home : "/tmp") + "/.cache";
+            mkdir(base.c_str(), 0755);
+            string dir = base + "/player";
+            mkdir(dir.c_str(), 0755);
+            return dir;
+        }
+
+        // the cache file for id, other per-file caches pick their own extension.
+        static string entryPath(const FileIdentity& id, const char* extension = ".streaminfo") {
+            std::stringstream ss{};
+            ss << cacheDir() << "/" << std::hex << std::hash<string>{}(id.path) << extension;
+            return ss.str();
+        }
+
+    private:
+        static string toHex(const uint8_t* data, int size) {
+            if (size <= 0) {
+                return "-";
+            }
+            static const char* digits = "0123456789abcdef";
+            string s;
+            for (int i = 0; i < size; i++) {
+                s += digits[data[i] >> 4];
+                s += digits[data[i] & 0xf];
+            }
+            return s;
+        }
+
+        static bool fromHex(const string& s, std::vector<uint8_t>& data) {
+            data.clear();
+            if (s == "-") {
+                return true;
+            }
+            auto digit = [](char c) {
+                return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+            };
+            for (size_t i = 0; i + 1 < s.size(); i += 2) {
+                int hi = digit(s[i]);
+                int lo = digit(s[i + 1]);
+                if (hi < 0 || lo < 0) {
+                    return false;
+                }
+                data.push_back((uint8_t)(hi << 4 | lo));
+            }
+            return true;
+        }
+
+        static void writeStream(std::ostream& os, const AVStream* st) {
+            const AVCodecParameters* p = st->codecpar;
+            os << "stream " << (int)p->codec_type << " " << (int)p->codec_id << " " << p->codec_tag << " "
+               << p->format << " " << p->bit_rate << " " << p->bits_per_coded_sample << " "
+               << p->bits_per_raw_sample << " " << p->profile << " " << p->level << " " << p->width << " "
+               << p->height << " " << p->sample_aspect_ratio.num << " " << p->sample_aspect_ratio.den << " "
+               << p->channel_layout << " " << p->channels << " " << p->sample_rate << " " << p->block_align
+               << " " << p->frame_size << " " << p->initial_padding << " " << p->trailing_padding << " "
+               << p->seek_preroll << " " << p->video_delay << " " << st->time_base.num << " "
+               << st->time_base.den << " " << st->avg_frame_rate.num << " " << st->avg_frame_rate.den << " "
+               << st->r_frame_rate.num << " " << st->r_frame_rate.den << " " << st->start_time << " "
+               << st->duration << " " << toHex(p->extradata, p->extradata_size) << "\n";
+        }
+
+        // one cached stream line, parsed and checked before anything is applied.
+        struct CachedStream {
+            int type;
+            int codecId;
+            int format;
+            AVCodecParameters c{};
+            std::vector<uint8_t> extradata{};
+            AVRational tb;
+            AVRational afr;
+            AVRational rfr;
+            int64_t startTime;
+            int64_t duration;
+        };
+
+        // false if the line is malformed or contradicts what the demuxer found for st.
+        static bool readStream(const string& line, const AVStream* st, CachedStream& cached) {
+            std::istringstream is{line};
+            string tag, extradata;
+            AVCodecParameters& c = cached.c;
+            is >> tag >> cached.type >> cached.codecId >> c.codec_tag >> cached.format >> c.bit_rate
+               >> c.bits_per_coded_sample >> c.bits_per_raw_sample >> c.profile >> c.level >> c.width >> c.height
+               >> c.sample_aspect_ratio.num >> c.sample_aspect_ratio.den >> c.channel_layout >> c.channels
+               >> c.sample_rate >> c.block_align >> c.frame_size >> c.initial_padding >> c.trailing_padding
+               >> c.seek_preroll >> c.video_delay >> cached.tb.num >> cached.tb.den >> cached.afr.num
+               >> cached.afr.den >> cached.rfr.num >> cached.rfr.den >> cached.startTime >> cached.duration
+               >> extradata;
+            if (!is || tag != "stream" || !fromHex(extradata, cached.extradata)) {
+                return false;
+            }
+            const AVCodecParameters* p = st->codecpar;
+            return (p->codec_type == AVMEDIA_TYPE_UNKNOWN || p->codec_type == cached.type) &&
+                   (p->codec_id == AV_CODEC_ID_NONE || p->codec_id == cached.codecId);
+        }
+
+        static void applyStream(const CachedStream& cached, AVStream* st) {
+            const AVCodecParameters& c = cached.c;
+            AVCodecParameters* p = st->codecpar;
+            p->codec_type = (AVMediaType)cached.type;
+            p->codec_id = (AVCodecID)cached.codecId;
+            p->codec_tag = c.codec_tag;
+            p->format = cached.format;
+            p->bit_rate = c.bit_rate;
+            p->bits_per_coded_sample = c.bits_per_coded_sample;
+            p->bits_per_raw_sample = c.bits_per_raw_sample;
+            p->profile = c.profile;
+            p->level = c.level;
+            p->width = c.width;
+            p->height = c.height;
+            p->sample_aspect_ratio = c.sample_aspect_ratio;
+            p->channel_layout = c.channel_layout;
+            p->channels = c.channels;
+            p->sample_rate = c.sample_rate;
+            p->block_align = c.block_align;
+            p->frame_size = c.frame_size;
+            p->initial_padding = c.initial_padding;
+            p->trailing_padding = c.trailing_padding;
+            p->seek_preroll = c.seek_preroll;
+            p->video_delay = c.video_delay;
+            if (p->extradata == nullptr && !cached.extradata.empty()) {
+                int n = (int)cached.extradata.size();
+                p->extradata = (uint8_t*)av_mallocz(n + AV_INPUT_BUFFER_PADDING_SIZE);
+                if (p->extradata != nullptr) {
+                    memcpy(p->extradata, cached.extradata.data(), n);
+                    p->extradata_size = n;
+                }
+            }
+
+            if (st->time_base.num == 0 || st->time_base.den == 0) {
+                st->time_base = cached.tb;
+            }
+            st->avg_frame_rate = cached.afr;
+            st->r_frame_rate = cached.rfr;
+            if (st->start_time == AV_NOPTS_VALUE) {
+                st->start_time = cached.startTime;
+            }
+            if (st->duration == AV_NOPTS_VALUE) {
+                st->duration = cached.duration;
+            }
+        }
+
+    public:
+        /*
+         * Applies a cached entry to a context returned by avformat_open_input.
+         * @return false when there is no valid entry, the caller has to probe.
+         */
+        static bool load(AVFormatContext* formatCtx, const string& url) {
+            FileIdentity id;
+            if (!identify(url, id)) {
+                return false;
+            }
+            std::ifstream is{entryPath(id)};
+            if (!is.is_open()) {
+                return false;
+            }
+
+            string line, tag;
+            int version = -1;
+            int64_t size = -1, mtime = -1, duration, startTime, bitRate;
+            unsigned int nbStreams = 0;
+            std::getline(is, line);
+            std::istringstream{line} >> tag >> version;
+            if (tag != "player-streaminfo" || version != VERSION) {
+                return false;
+            }
+            std::getline(is, line);
+            if (line != "path " + id.path) {
+                return false;
+            }
+            std::getline(is, line);
+            std::istringstream{line} >> tag >> size >> mtime;
+            if (size != id.size || mtime != id.mtime) {
+                return false;
+            }
+            std::getline(is, line);
+            std::istringstream format{line};
+            format >> tag >> duration >> startTime >> bitRate >> nbStreams;
+            if (!format || nbStreams != formatCtx->nb_streams) {
+                return false;
+            }
+
+            // all or nothing: a stream that does not match leaves the context as the demuxer made it.
+            std::vector<CachedStream> streams(nbStreams);
+            for (unsigned int i = 0; i < nbStreams; i++) {
+                if (!std::getline(is, line) || !readStream(line, formatCtx->streams[i], streams[i])) {
+                    cout << "stream info cache entry does not match: " << id.path << endl;
+                    return false;
+                }
+            }
+            for (unsigned int i = 0; i < nbStreams; i++) {
+                applyStream(streams[i], formatCtx->streams[i]);
+            }
+            if (formatCtx->duration == AV_NOPTS_VALUE) {
+                formatCtx->duration = duration;
+            }
+            if (formatCtx->start_time == AV_NOPTS_VALUE) {
+                formatCtx->start_time = startTime;
+            }
+            if (formatCtx->bit_rate <= 0) {
+                formatCtx->bit_rate = bitRate;
+            }
+            return true;
+        }
+
+        // stores the result of avformat_find_stream_info, silently ignored for non-file urls.
+        static void store(const AVFormatContext* formatCtx, const string& url) {
+            FileIdentity id;
+            if (!identify(url, id)) {
+                return;
+            }
+            string path = entryPath(id);
+            string tmpPath = path + ".tmp";
+            {
+                std::ofstream os{tmpPath, std::ios::trunc};
+                if (!os.is_open()) {
+                    return;
+                }
+                os << "player-streaminfo " << VERSION << "\n";
+                os << "path " << id.path << "\n";
+                os << "file " << id.size << " " << id.mtime << "\n";
+                os << "format " << formatCtx->duration << " " << formatCtx->start_time << " "
+                   << formatCtx->bit_rate << " " << formatCtx->nb_streams << "\n";
+                for (unsigned int i = 0; i < formatCtx->nb_streams; i++) {
+                    writeStream(os, formatCtx->streams[i]);
+                }
+                if (!os) {
+                    return;
+                }
+            }
+            std::rename(tmpPath.c_str(), path.c_str());
+        }
+    };
+
+}  // namespace ffmpegUtil
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Instrumentation.h"
+
+namespace ffmpegUtil {
+
+    using std::cout;
+    using std::endl;
+
+    // run count and busy time of one kind of task, updated by the scheduler.
+    struct TaskStats {
+        std::atomic<uint64_t> runs{0};
+        std::atomic<uint64_t> steals{0};
+        std::atomic<uint64_t> busyNanos{0};
+
+        double getBusyMs() const { return busyNanos.load() / 1e6; }
+    };
+
+    /*
+     * Fixed pool of worker threads with one task deque each.
+     *
+     * A task submitted from a worker goes to that worker's deque and is popped LIFO, which keeps a
+     * processor's follow-up work on the core that has its decoder state in cache. Other submissions
+     * are spread round-robin. An idle worker steals the oldest task of another worker before it
+     * goes to sleep. Workers are joined in the destructor after the queued tasks have run.
+     */
+    class TaskScheduler {
+        struct Task {
+            std::function<void()> run;
+            TaskStats* stats;
+        };
+
+        struct Worker {
+            std::mutex dequeMutex{};
+            std::deque<Task> tasks{};
+            std::thread thread{};
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers{};
+        std::atomic<uint64_t> pending{0};
+        std::atomic<uint64_t> nextWorker{0};
+        std::atomic<int> sleepingWorkers{0};
+        std::atomic<bool> stopping{false};
+        std::mutex sleepMutex{};
+        std::condition_variable sleepCv{};
+
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> stolen{0};
+
+        struct WorkerIdentity {
+            const TaskScheduler* scheduler = nullptr;
+            int index = -1;
+        };
+
+        static WorkerIdentity& currentWorker() {
+            static thread_local WorkerIdentity identity{};
+            return identity;
+        }
+
+        bool popLocal(int index, Task& task) {
+            Worker& w = *workers[index];
+            std::lock_guard<std::mutex> lg(w.dequeMutex);
+            if (w.tasks.empty()) {
+                return false;
+            }
+            task = std::move(w.tasks.back());
+            w.tasks.pop_back();
+            return true;
+        }
+
+        bool steal(int thief, Task& task) {
+            int n = (int)workers.size();
+            for (int i = 1; i < n; i++) {
+                Worker& w = *workers[(thief + i) % n];
+                std::lock_guard<std::mutex> lg(w.dequeMutex);
+                if (!w.tasks.empty()) {
+                    task = std::move(w.tasks.front());
+                    w.tasks.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void runTask(Task& task, bool wasStolen) {
+            pending--;
+            auto begin = std::chrono::steady_clock::now();
+            task.run();
+            auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - begin).count();
+            executed++;
+            if (wasStolen) {
+                stolen++;
+            }
+            if (task.stats != nullptr) {
+                task.stats->runs++;
+                task.stats->busyNanos += nanos;
+                if (wasStolen) {
+                    task.stats->steals++;
+                }
+            }
+        }
+
+        void workerLoop(int index) {
+            currentWorker() = WorkerIdentity{this, index};
+            Instrumentation::instance().nameThread(("worker-" + std::to_string(index)).c_str());
+            while (true) {
+                Task task;
+                if (popLocal(index, task)) {
+                    runTask(task, false);
+                    continue;
+                }
+                if (steal(index, task)) {
+                    runTask(task, true);
+                    continue;
+                }
+                std::unique_lock<std::mutex> lk{sleepMutex};
+                sleepingWorkers++;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                sleepCv.wait(lk, [this] { return pending.load() > 0 || stopping.load(); });
+                sleepingWorkers--;
+                if (stopping.load() && pending.load() == 0) {
+                    break;
+                }
+            }
+        }
+
+    public:
+        TaskScheduler(const TaskScheduler&) = delete;
+        TaskScheduler(TaskScheduler&&) noexcept = delete;
+        TaskScheduler operator=(const TaskScheduler&) = delete;
+
+        // workerCount 0: one worker per core.
+        explicit TaskScheduler(int workerCount = 0) {
+            int n = workerCount > 0 ? workerCount : std::max(1, (int)std::thread::hardware_concurrency());
+            for (int i = 0; i < n; i++) {
+                workers.emplace_back(new Worker());
+            }
+            for (int i = 0; i < n; i++) {
+                workers[i]->thread = std::thread{&TaskScheduler::workerLoop, this, i};
+            }
+        }
+
+        ~TaskScheduler() {
+            {
+                std::lock_guard<std::mutex> lg(sleepMutex);
+                stopping.store(true);
+            }
+            sleepCv.notify_all();
+            for (auto& w : workers) {
+                w->thread.join();
+            }
+            cout << "~TaskScheduler called. executed=" << executed.load() << " stolen=" << stolen.load() << endl;
+        }
+
+        // the scheduler all processors share unless they are given another one.
+        static TaskScheduler& shared() {
+            static TaskScheduler scheduler{};
+            return scheduler;
+        }
+
+        // stats, if given, are updated after run returned and must outlive that, not just the task.
+        void submit(std::function<void()> run, TaskStats* stats = nullptr) {
+            const WorkerIdentity& self = currentWorker();
+            int index = self.scheduler == this ? self.index : (int)(nextWorker++ % workers.size());
+            {
+                Worker& w = *workers[index];
+                std::lock_guard<std::mutex> lg(w.dequeMutex);
+                w.tasks.push_back(Task{std::move(run), stats});
+            }
+            pending++;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (sleepingWorkers.load() > 0) {
+                std::lock_guard<std::mutex> lg(sleepMutex);
+                sleepCv.notify_one();
+            }
+        }
+
+        int getWorkerCount() const { return (int)workers.size(); }
+
+        uint64_t getExecuted() const { return executed.load(); }
+
+        uint64_t getStolen() const { return stolen.load(); }
+    };
+
+}  // namespace ffmpegUtil
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include "ffmpegUtil.h"
+#include "Logger.h"
+
+extern "C" {
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+}
+
+namespace ffmpegUtil {
+
+    /*
+     * Pitch-preserving time stretch of interleaved pcm through libavfilter's atempo (WSOLA),
+     * for playback faster or slower than real time. The format stays the same from input to
+     * output; one atempo instance only covers 0.5x to 2x, larger factors chain several.
+     *
+     * atempo buffers some input, so a frame in does not make exactly rate-scaled samples out;
+     * process() returns whatever the graph has ready. reset() drops what it holds, e.g. after a
+     * seek.
+     */
+    class TempoFilter {
+        AVFilterGraph* graph = nullptr;
+        AVFilterContext* source = nullptr;
+        AVFilterContext* sink = nullptr;
+        AVFrame* filtered = av_frame_alloc();
+        const AudioInfo info;
+        double rate = 1.0;
+        int64_t inputSamples = 0;
+
+        void freeGraph() {
+            avfilter_graph_free(&graph);
+            source = nullptr;
+            sink = nullptr;
+        }
+
+        // "atempo=2,atempo=1.5" for 3x, then back to the input format.
+        std::string describe() const {
+            std::string chain;
+            double left = rate;
+            while (left > 2.0) {
+                chain += "atempo=2,";
+                left /= 2.0;
+            }
+            while (left < 0.5) {
+                chain += "atempo=0.5,";
+                left /= 0.5;
+            }
+            char tail[160];
+            std::snprintf(tail, sizeof(tail), "atempo=%.6f,aformat=sample_fmts=%s:sample_rates=%d:channel_layouts=0x%llx",
+                          left, av_get_sample_fmt_name(info.format), info.sampleRate,
+                          (unsigned long long)info.layout);
+            return chain + tail;
+        }
+
+        void build() {
+            freeGraph();
+            inputSamples = 0;
+            graph = avfilter_graph_alloc();
+            if (graph == nullptr) {
+                throw std::runtime_error("can not allocate filter graph.");
+            }
+            char args[256];
+            std::snprintf(args, sizeof(args), "time_base=1/%d:sample_rate=%d:sample_fmt=%s:channel_layout=0x%llx",
+                          info.sampleRate, info.sampleRate, av_get_sample_fmt_name(info.format),
+                          (unsigned long long)info.layout);
+            if (avfilter_graph_create_filter(&source, avfilter_get_by_name("abuffer"), "in", args, nullptr, graph) < 0 ||
+                avfilter_graph_create_filter(&sink, avfilter_get_by_name("abuffersink"), "out", nullptr, nullptr,
+                                             graph) < 0) {
+                freeGraph();
+                throw std::runtime_error("can not create tempo filter endpoints.");
+            }
+
+            // the chain's open input is fed by source, its open output feeds sink.
+            AVFilterInOut* outputs = avfilter_inout_alloc();
+            AVFilterInOut* inputs = avfilter_inout_alloc();
+            outputs->name = av_strdup("in");
+            outputs->filter_ctx = source;
+            outputs->pad_idx = 0;
+            outputs->next = nullptr;
+            inputs->name = av_strdup("out");
+            inputs->filter_ctx = sink;
+            inputs->pad_idx = 0;
+            inputs->next = nullptr;
+            std::string chain = describe();
+            int ret = avfilter_graph_parse_ptr(graph, chain.c_str(), &inputs, &outputs, nullptr);
+            avfilter_inout_free(&inputs);
+            avfilter_inout_free(&outputs);
+            if (ret < 0 || avfilter_graph_config(graph, nullptr) < 0) {
+                freeGraph();
+                throw std::runtime_error("can not configure tempo filter: " + chain);
+            }
+            LOG_INFO("tempo filter: " << chain);
+        }
+
+        // appends f to pcm starting at sample offset, growing pcm's buffer (keeping its samples) if needed.
+        void append(AVFrame* pcm, int offset, const AVFrame* f) {
+            int bytesPerSample = av_get_bytes_per_sample(info.format) * info.channels;
+            int capacity = pcm->buf[0] != nullptr ? pcm->linesize[0] / bytesPerSample : 0;
+            if (capacity < offset + f->nb_samples) {
+                AVFrame* grown = av_frame_alloc();
+                grown->format = info.format;
+                grown->channel_layout = info.layout;
+                grown->channels = info.channels;
+                grown->sample_rate = info.sampleRate;
+                grown->nb_samples = std::max(offset + f->nb_samples, capacity * 2);
+                if (av_frame_get_buffer(grown, 0) < 0) {
+                    av_frame_free(&grown);
+                    throw std::runtime_error("can not allocate audio frame.");
+                }
+                if (offset > 0) {
+                    memcpy(grown->data[0], pcm->data[0], (size_t)offset * bytesPerSample);
+                }
+                av_frame_unref(pcm);
+                av_frame_move_ref(pcm, grown);
+                av_frame_free(&grown);
+            }
+            memcpy(pcm->data[0] + (size_t)offset * bytesPerSample, f->data[0], (size_t)f->nb_samples * bytesPerSample);
+            pcm->nb_samples = offset + f->nb_samples;
+        }
+
+    public:
+        TempoFilter(const TempoFilter&) = delete;
+        TempoFilter(TempoFilter&&) noexcept = delete;
+        TempoFilter operator=(const TempoFilter&) = delete;
+
+        // info: the interleaved format in and out.
+        explicit TempoFilter(AudioInfo audioInfo, double r = 1.0) : info(audioInfo), rate(r) {
+            if (av_sample_fmt_is_planar(info.format)) {
+                av_frame_free(&filtered);
+                throw std::runtime_error("tempo filter takes interleaved pcm.");
+            }
+            build();
+        }
+
+        ~TempoFilter() {
+            freeGraph();
+            av_frame_free(&filtered);
+        }
+
+        double getRate() const { return rate; }
+
+        // a new factor starts from an empty graph, like reset().
+        void setRate(double r) {
+            rate = r;
+            build();
+        }
+
+        void reset() { build(); }
+
+        /*
+         * Stretches in (samples in in->nb_samples) and writes what the filter has ready to out,
+         * which keeps its buffers unless they are too small. out->nb_samples becomes the output
+         * sample count, which may be 0 while atempo fills its window.
+         * @return samples per channel and bytes of output.
+         */
+        std::tuple<int, int> process(AVFrame* in, AVFrame* out) {
+            in->pts = inputSamples;
+            inputSamples += in->nb_samples;
+            // the graph takes its own reference to in's buffers, see av_frame_is_writable before reusing them.
+            if (av_buffersrc_add_frame_flags(source, in, AV_BUFFERSRC_FLAG_KEEP_REF) < 0) {
+                throw std::runtime_error("tempo filter rejected a frame.");
+            }
+            int samples = 0;
+            while (av_buffersink_get_frame(sink, filtered) >= 0) {
+                append(out, samples, filtered);
+                samples += filtered->nb_samples;
+                av_frame_unref(filtered);
+            }
+            out->nb_samples = samples;
+            return std::tuple<int, int>{samples,
+                                        samples * info.channels * av_get_bytes_per_sample(info.format)};
+        }
+    };
+
+}  // namespace ffmpegUtil
@@ -9,9 +9,21 @@ extern "C" {
 
 };
 #include <string>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <sstream>
+#include <thread>
 #include <tuple>
+#include <memory>
+#include <chrono>
+#include <vector>
+#include "MmapInput.h"
+#include "PrefetchInput.h"
+#include "StreamInfoCache.h"
+#include "KeyframeIndex.h"
+#include "Instrumentation.h"
+#include "Logger.h"
 
 namespace ffmpegUtil {
 
@@ -20,10 +32,76 @@ namespace ffmpegUtil {
     using std::string;
     using std::stringstream;
 
+    // how a decoder spreads its work over threads.
+    struct DecoderThreading {
+        enum Type { AUTO, FRAME, SLICE, NONE };
+
+        // AUTO: frame threading where the codec supports it (slice otherwise), single thread for audio.
+        Type type = AUTO;
+        // 0: derived from core count, resolution and the threaded decoders already open.
+        int threadCount = 0;
+
+        DecoderThreading() = default;
+
+        DecoderThreading(Type t, int n = 0) : type(t), threadCount(n) {}
+    };
+
     struct ffUtils {
-        static void initCodecContext(AVFormatContext* f, int streamIndex, AVCodecContext** ctx) {
+        // decoders opened with more than one thread and not freed yet, they share the cores.
+        static std::atomic<int>& threadedDecoders() {
+            static std::atomic<int> count{0};
+            return count;
+        }
+
+        static void applyThreading(AVCodecContext* codecCtx, const AVCodec* codec, const DecoderThreading& threading) {
+            bool frameCapable = (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) != 0;
+            bool sliceCapable = (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) != 0;
+            auto type = threading.type;
+            if (type == DecoderThreading::AUTO && codecCtx->codec_type != AVMEDIA_TYPE_VIDEO) {
+                type = DecoderThreading::NONE;
+            }
+            if (type == DecoderThreading::FRAME && !frameCapable) {
+                type = DecoderThreading::SLICE;
+            }
+            if (type == DecoderThreading::NONE || (type == DecoderThreading::SLICE && !sliceCapable) ||
+                (type == DecoderThreading::AUTO && !frameCapable && !sliceCapable)) {
+                codecCtx->thread_count = 1;
+                return;
+            }
+
+            int threads = threading.threadCount;
+            if (threads <= 0) {
+                int cores = std::max(1, (int)std::thread::hardware_concurrency());
+                int share = std::max(1, cores / (threadedDecoders().load() + 1));
+                // more threads than this only add frame latency at these sizes.
+                int64_t pixels = (int64_t)codecCtx->width * codecCtx->height;
+                int useful = pixels <= 1280 * 720 ? 4 : pixels <= 1920 * 1080 ? 8 : 16;
+                threads = std::min(share, useful);
+            }
+            codecCtx->thread_count = threads;
+            if (type == DecoderThreading::FRAME) {
+                codecCtx->thread_type = FF_THREAD_FRAME;
+            } else if (type == DecoderThreading::SLICE) {
+                codecCtx->thread_type = FF_THREAD_SLICE;
+            } else {
+                codecCtx->thread_type = (frameCapable ? FF_THREAD_FRAME : 0) | (sliceCapable ? FF_THREAD_SLICE : 0);
+            }
+        }
+
+        static void freeCodecContext(AVCodecContext** ctx) {
+            if (*ctx == nullptr) {
+                return;
+            }
+            if ((*ctx)->thread_count > 1) {
+                threadedDecoders()--;
+            }
+            avcodec_free_context(ctx);
+        }
+
+        static void initCodecContext(AVFormatContext* f, int streamIndex, AVCodecContext** ctx,
+                                     const DecoderThreading& threading = DecoderThreading()) {
             string codecTypeStr{};
-            switch (f->streams[streamIndex]->codec->codec_type) {
+            switch (f->streams[streamIndex]->codecpar->codec_type) {
                 case AVMEDIA_TYPE_VIDEO:
                     codecTypeStr = "vidoe_decodec";
                     break;
@@ -49,30 +127,122 @@ namespace ffmpegUtil {
             if (avcodec_parameters_to_context(codecCtx, f->streams[streamIndex]->codecpar) != 0) {
                 string errorMsg = "Could not copy codec context: ";
                 errorMsg += codec->name;
+                avcodec_free_context(ctx);
                 cout << errorMsg << endl;
                 throw std::runtime_error(errorMsg);
             }
 
+            applyThreading(codecCtx, codec, threading);
+
             if (avcodec_open2(codecCtx, codec, nullptr) < 0) { //打开解码器
                 string errorMsg = "Could not open codec: ";
                 errorMsg += codec->name;
+                avcodec_free_context(ctx);
                 cout << errorMsg << endl;
                 throw std::runtime_error(errorMsg);
             }
+            if (codecCtx->thread_count > 1) {
+                threadedDecoders()++;
+            }
 
+            const char* threadType = codecCtx->active_thread_type & FF_THREAD_FRAME ? "frame"
+                                   : codecCtx->active_thread_type & FF_THREAD_SLICE ? "slice" : "none";
             cout << codecTypeStr << " [" << codecCtx->codec->name
-                 << "] codec context initialize success." << endl;
+                 << "] codec context initialize success. threads=" << codecCtx->thread_count
+                 << " threading=" << threadType << endl;
+        }
+
+        /*
+         * avformat_find_stream_info, unless useCache is set and the stream info cache has a valid
+         * entry for this file. A fresh probe result is written back to the cache.
+         * @return false if probing failed.
+         */
+        static bool findStreamInfo(AVFormatContext* f, const string& url, bool useCache) {
+            if (useCache && StreamInfoCache::load(f, url)) {
+                cout << "stream info loaded from cache: " << url << endl;
+                return true;
+            }
+            if (avformat_find_stream_info(f, NULL) < 0) {
+                return false;
+            }
+            if (useCache) {
+                StreamInfoCache::store(f, url);
+            }
+            return true;
+        }
+
+        // bounded probing for avformat_open_input, trades accuracy on odd files for startup time.
+        static void setFastProbe(AVDictionary** options) {
+            av_dict_set_int(options, "probesize", 512 * 1024, 0);
+            av_dict_set_int(options, "analyzeduration", 500 * 1000, 0);
+            av_dict_set_int(options, "fpsprobesize", 3, 0);
         }
     };
 
+    struct InputOptions {
+        enum IO { DEFAULT_IO, MMAP_IO, PREFETCH_IO };
+
+        // non-default io only applies to local files, other urls always use the default io.
+        IO io = DEFAULT_IO;
+        // PREFETCH_IO: memory reserved for read-ahead.
+        int prefetchWindowMB = 32;
+        // PREFETCH_IO: if > 0, shrink the window to this many seconds at the file's bitrate.
+        double prefetchWindowSeconds = 0;
+        // reuse the stream layout of earlier opens of the same local file instead of probing.
+        bool useStreamInfoCache = true;
+        // bounded probesize / analyzeduration when probing is needed.
+        bool fastProbe = false;
+        // streams to demux, -1 picks the first stream of the type. the demuxer skips all others.
+        int videoStream = -1;
+        int audioStream = -1;
+
+        InputOptions() = default;
+
+        InputOptions(IO i) : io(i) {}
+    };
+
     class PacketGrabber {
         const string inputUrl;
         AVFormatContext* formatCtx = nullptr;
+        std::unique_ptr<MmapInput> mmapInput{};
+        std::unique_ptr<PrefetchInput> prefetchInput{};
         bool fileGotToEnd = false;
 
         int videoIndex = -1;
         int audioIndex = -1;
 
+        double openMs = 0;
+
+        // keyframes of the video stream (audio if there is none), used to land seeks on them.
+        KeyframeIndex keyframeIndex{};
+        int seekStreamIndex = -1;
+
+        int pickStream(AVMediaType type, int wanted) const {
+            if (wanted >= 0) {
+                if (wanted >= (int)formatCtx->nb_streams || formatCtx->streams[wanted]->codecpar->codec_type != type) {
+                    string errorMsg = "stream " + std::to_string(wanted) + " is not a " +
+                                      av_get_media_type_string(type) + " stream: " + inputUrl;
+                    cout << errorMsg << endl;
+                    throw std::runtime_error(errorMsg);
+                }
+                return wanted;
+            }
+            for (int i = 0; i < formatCtx->nb_streams; i++) {
+                if (formatCtx->streams[i]->codecpar->codec_type == type) {
+                    return i;
+                }
+            }
+            return -1;
+        }
+
+        // unselected streams are dropped inside the demuxer instead of being read and freed.
+        void applyStreamSelection() {
+            for (int i = 0; i < formatCtx->nb_streams; i++) {
+                bool selected = i == videoIndex || i == audioIndex;
+                formatCtx->streams[i]->discard = selected ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+            }
+        }
+
     public:
         ~PacketGrabber() {
             if (formatCtx != nullptr) {
@@ -81,55 +251,166 @@ namespace ffmpegUtil {
             }
             cout << "~PacketGrabber called." << endl;
         }
-        PacketGrabber(const string& uri) : inputUrl(uri) {
+        PacketGrabber(const string& uri, const InputOptions& options = InputOptions()) : inputUrl(uri) {
+            auto openBegin = std::chrono::steady_clock::now();
             formatCtx = avformat_alloc_context();
 
-            if (avformat_open_input(&formatCtx, inputUrl.c_str(), NULL, NULL) != 0) {
+            string localPath = options.io != InputOptions::DEFAULT_IO ? MmapInput::localPath(inputUrl) : "";
+            if (!localPath.empty()) {
+                try {
+                    if (options.io == InputOptions::MMAP_IO) {
+                        mmapInput.reset(new MmapInput(localPath));
+                        formatCtx->pb = mmapInput->getAvioContext();
+                    } else {
+                        prefetchInput.reset(new PrefetchInput(localPath, options.prefetchWindowMB));
+                        formatCtx->pb = prefetchInput->getAvioContext();
+                    }
+                    formatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+                } catch (std::runtime_error& e) {
+                    cout << e.what() << ", fall back to default io." << endl;
+                    mmapInput.reset();
+                    prefetchInput.reset();
+                }
+            }
+
+            AVDictionary* openOptions = nullptr;
+            if (options.fastProbe) {
+                ffUtils::setFastProbe(&openOptions);
+            }
+            int ret = avformat_open_input(&formatCtx, inputUrl.c_str(), NULL, &openOptions);
+            av_dict_free(&openOptions);
+            if (ret != 0) {
                 string errorMsg = "Can not open input file:";
                 errorMsg += inputUrl;
                 cout << errorMsg << endl;
                 throw std::runtime_error(errorMsg);
             }
 
-            if (avformat_find_stream_info(formatCtx, NULL) < 0) {
+            if (!ffUtils::findStreamInfo(formatCtx, inputUrl, options.useStreamInfoCache)) {
                 string errorMsg = "Can not find stream information in input file:";
                 errorMsg += inputUrl;
                 cout << errorMsg << endl;
                 throw std::runtime_error(errorMsg);
             }
 
-            for (int i = 0; i < formatCtx->nb_streams; i++) {
-                if (formatCtx->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO && videoIndex == -1) {
-                    videoIndex = i;
-                    cout << "video stream index = : [" << i << "]" << endl;
-                }
+            if (prefetchInput != nullptr && options.prefetchWindowSeconds > 0 && formatCtx->bit_rate > 0) {
+                prefetchInput->setWindowBytes((int64_t)(formatCtx->bit_rate / 8 * options.prefetchWindowSeconds));
+            }
 
-                if (formatCtx->streams[i]->codec->codec_type == AVMEDIA_TYPE_AUDIO && audioIndex == -1) {
-                    audioIndex = i;
-                    cout << "audio stream index = : [" << i << "]" << endl;
-                }
+            videoIndex = pickStream(AVMEDIA_TYPE_VIDEO, options.videoStream);
+            audioIndex = pickStream(AVMEDIA_TYPE_AUDIO, options.audioStream);
+            cout << "video stream index = : [" << videoIndex << "]" << endl;
+            cout << "audio stream index = : [" << audioIndex << "]" << endl;
+            applyStreamSelection();
+
+            seekStreamIndex = videoIndex >= 0 ? videoIndex : audioIndex;
+            if (seekStreamIndex >= 0) {
+                keyframeIndex.reset(formatCtx->streams[seekStreamIndex]->time_base);
             }
+
+            std::chrono::duration<double, std::milli> openTime = std::chrono::steady_clock::now() - openBegin;
+            openMs = openTime.count();
+            cout << "input opened in " << openMs << "ms" << endl;
         }
 
         int grabPacket(AVPacket* pkt) {
             if (fileGotToEnd) {
                 return -1;
             }
+            StageTimer timer{Instrumentation::DEMUX};
             while (true) {
                 if (av_read_frame(formatCtx, pkt) >= 0) {
+                    if (pkt->stream_index == seekStreamIndex) {
+                        keyframeIndex.addPacket(pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts,
+                                                (pkt->flags & AV_PKT_FLAG_KEY) != 0);
+                    }
                     return pkt->stream_index;
                 } else {
                     // file end;
                     fileGotToEnd = true;
+                    keyframeIndex.markComplete();
                     return -1;
                 }
             }
         }
 
+        /*
+         * Repositions the demuxer on the last keyframe at or before targetMs (stream pts in
+         * milliseconds). Must be called from the thread that calls grabPacket.
+         * @return false if the demuxer could not seek, the read position is then unchanged.
+         */
+        bool seek(int64_t targetMs) {
+            if (seekStreamIndex < 0) {
+                return false;
+            }
+            AVStream* st = formatCtx->streams[seekStreamIndex];
+            int64_t target = av_rescale_q(targetMs, AVRational{1, 1000}, st->time_base);
+            int64_t keyframe = keyframeIndex.findPreceding(target);
+            int64_t seekTs = keyframe != AV_NOPTS_VALUE ? keyframe : target;
+
+            int ret = av_seek_frame(formatCtx, seekStreamIndex, seekTs, AVSEEK_FLAG_BACKWARD);
+            if (ret < 0) {
+                LOG_ERROR("seek to " << targetMs << "ms failed: " << ret);
+                return false;
+            }
+            keyframeIndex.onDiscontinuity(seekTs);
+            fileGotToEnd = false;
+            LOG_INFO("seek to " << targetMs << "ms, keyframe "
+                     << (keyframe != AV_NOPTS_VALUE ? "from index" : "from demuxer"));
+            return true;
+        }
+
+        /*
+         * Demuxes audio stream index instead of the current one from the next packet on.
+         * Must be called from the thread that calls grabPacket.
+         * @return false if index is not an audio stream.
+         */
+        bool selectAudioStream(int index) {
+            if (index < 0 || index >= (int)formatCtx->nb_streams ||
+                formatCtx->streams[index]->codecpar->codec_type != AVMEDIA_TYPE_AUDIO) {
+                return false;
+            }
+            audioIndex = index;
+            applyStreamSelection();
+            if (videoIndex < 0 && seekStreamIndex != audioIndex) {
+                seekStreamIndex = audioIndex;
+                keyframeIndex.reset(formatCtx->streams[seekStreamIndex]->time_base);
+            }
+            cout << "audio stream index = : [" << audioIndex << "]" << endl;
+            return true;
+        }
+
+        // indexes of all audio streams in the file.
+        std::vector<int> getAudioStreams() const {
+            std::vector<int> streams{};
+            for (int i = 0; i < formatCtx->nb_streams; i++) {
+                if (formatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+                    streams.push_back(i);
+                }
+            }
+            return streams;
+        }
+
+        int getVideoIndex() const { return videoIndex; }
+
+        int getAudioIndex() const { return audioIndex; }
+
+        KeyframeIndex& getKeyframeIndex() { return keyframeIndex; }
+
         AVFormatContext* getFormatCtx() const { return formatCtx; }
 
         bool isFileEnd() const { return fileGotToEnd; }
 
+        bool isMmapInput() const { return mmapInput != nullptr; }
+
+        bool isPrefetchInput() const { return prefetchInput != nullptr; }
+
+        // avformat_open_input + stream info, in milliseconds.
+        double getOpenMs() const { return openMs; }
+
+        // time av_read_frame spent waiting for the read-ahead stage, 0 without PREFETCH_IO.
+        double getIoStallMs() const { return prefetchInput != nullptr ? prefetchInput->getStallMs() : 0; }
+
     };
 
 
@@ -150,15 +431,64 @@ namespace ffmpegUtil {
                 : layout(l), sampleRate(rate), channels(c), format(f) {}
     };
 
-    class ReSampler {
+    // compile-time description of the sample formats a resampler can output.
+    template <AVSampleFormat F>
+    struct SampleFormatTraits;
+
+    template <> struct SampleFormatTraits<AV_SAMPLE_FMT_U8> { using Sample = uint8_t; static constexpr bool PLANAR = false; };
+    template <> struct SampleFormatTraits<AV_SAMPLE_FMT_S16> { using Sample = int16_t; static constexpr bool PLANAR = false; };
+    template <> struct SampleFormatTraits<AV_SAMPLE_FMT_S32> { using Sample = int32_t; static constexpr bool PLANAR = false; };
+    template <> struct SampleFormatTraits<AV_SAMPLE_FMT_FLT> { using Sample = float; static constexpr bool PLANAR = false; };
+    template <> struct SampleFormatTraits<AV_SAMPLE_FMT_DBL> { using Sample = double; static constexpr bool PLANAR = false; };
+    template <> struct SampleFormatTraits<AV_SAMPLE_FMT_S16P> { using Sample = int16_t; static constexpr bool PLANAR = true; };
+    template <> struct SampleFormatTraits<AV_SAMPLE_FMT_S32P> { using Sample = int32_t; static constexpr bool PLANAR = true; };
+    template <> struct SampleFormatTraits<AV_SAMPLE_FMT_FLTP> { using Sample = float; static constexpr bool PLANAR = true; };
+    template <> struct SampleFormatTraits<AV_SAMPLE_FMT_DBLP> { using Sample = double; static constexpr bool PLANAR = true; };
+
+    /*
+     * swresample conversion to the sample format OutFormat, fixed at compile time.
+     *
+     * Output is sized with swr_get_out_samples (the input plus what swr still buffers), buffers
+     * only grow when a frame needs more than they hold, and they are never cleared: everything
+     * handed out was just written by swr_convert.
+     */
+    template <AVSampleFormat OutFormat>
+    class BasicReSampler {
+        using Traits = SampleFormatTraits<OutFormat>;
+
         SwrContext* swr;
+        std::vector<uint8_t*> planes;  // the resampler's own buffer, one pointer per plane
+        int bufferSamples = 0;
+
+        void reserve(int samples) {
+            if (samples <= bufferSamples) {
+                return;
+            }
+            av_freep(&planes[0]);
+            if (av_samples_alloc(planes.data(), nullptr, out.channels, samples, OutFormat, 0) < 0) {
+                throw std::runtime_error("can not allocate resampler buffer.");
+            }
+            bufferSamples = samples;
+        }
+
+        std::tuple<int, int> convert(uint8_t** dst, int capacity, const AVFrame* frame) {
+            int outSamples = swr_convert(swr, dst, capacity, (const uint8_t**)frame->extended_data, frame->nb_samples);
+            if (outSamples < 0) {
+                throw std::runtime_error("swr_convert error: " + std::to_string(outSamples));
+            }
+            return std::tuple<int, int>{outSamples, getDataSize(outSamples)};
+        }
 
     public:
-        ReSampler(const ReSampler&) = delete;
-        ReSampler(ReSampler&&) noexcept = delete;
-        ReSampler operator=(const ReSampler&) = delete;
-        ~ReSampler() {
-            cout << "~ReSampler called." << endl;
+        using Sample = typename Traits::Sample;
+        static constexpr bool PLANAR = Traits::PLANAR;
+
+        BasicReSampler(const BasicReSampler&) = delete;
+        BasicReSampler(BasicReSampler&&) noexcept = delete;
+        BasicReSampler operator=(const BasicReSampler&) = delete;
+        ~BasicReSampler() {
+            LOG_INFO("~ReSampler called.");
+            av_freep(&planes[0]);
             if (swr != nullptr) {
                 swr_free(&swr);
             }
@@ -171,77 +501,71 @@ namespace ffmpegUtil {
             int64_t layout = AV_CH_LAYOUT_STEREO;
             int sampleRate = sr;
             int channels = 2;
-            AVSampleFormat format = AV_SAMPLE_FMT_S16;
 
-            return ffmpegUtil::AudioInfo(layout, sampleRate, channels, format);
+            return ffmpegUtil::AudioInfo(layout, sampleRate, channels, OutFormat);
         }
 
-        ReSampler(AudioInfo input, AudioInfo output) : in(input), out(output) {
+        BasicReSampler(AudioInfo input, AudioInfo output)
+                : planes(std::max(output.channels, 1), nullptr), in(input), out(output) {
+            if (out.format != OutFormat) {
+                throw std::runtime_error("resampler output format mismatch.");
+            }
             swr = swr_alloc_set_opts(nullptr, out.layout, out.format, out.sampleRate, in.layout,
                                      in.format, in.sampleRate, 0, nullptr);
 
-            if (swr_init(swr)) {
+            if (swr == nullptr || swr_init(swr)) {
                 throw std::runtime_error("swr_init error.");
             }
         }
 
-        int allocDataBuf(uint8_t** outData, int inputSamples) {
-            int bytePerOutSample = -1;
-            switch (out.format) {
-                case AV_SAMPLE_FMT_U8:
-                    bytePerOutSample = 1;
-                    break;
-                case AV_SAMPLE_FMT_S16P:
-                case AV_SAMPLE_FMT_S16:
-                    bytePerOutSample = 2;
-                    break;
-                case AV_SAMPLE_FMT_S32:
-                case AV_SAMPLE_FMT_S32P:
-                case AV_SAMPLE_FMT_FLT:
-                case AV_SAMPLE_FMT_FLTP:
-                    bytePerOutSample = 4;
-                    break;
-                case AV_SAMPLE_FMT_DBL:
-                case AV_SAMPLE_FMT_DBLP:
-                case AV_SAMPLE_FMT_S64:
-                case AV_SAMPLE_FMT_S64P:
-                    bytePerOutSample = 8;
-                    break;
-                default:
-                    bytePerOutSample = 2;
-                    break;
-            }
-
-            int guessOutSamplesPerChannel =
-                    av_rescale_rnd(inputSamples, out.sampleRate, in.sampleRate, AV_ROUND_UP);
-            int guessOutSize = guessOutSamplesPerChannel * out.channels * bytePerOutSample;
-
-            std::cout << "GuessOutSamplesPerChannel: " << guessOutSamplesPerChannel << std::endl;
-            std::cout << "GuessOutSize: " << guessOutSize << std::endl;
+        // bytes of samples per channel of output, all planes together.
+        int getDataSize(int samples) const { return samples * out.channels * (int)sizeof(Sample); }
 
-            guessOutSize *= 1.2;  // just make sure.
+        // the most samples per channel converting inputSamples more can produce.
+        int getMaxOutSamples(int inputSamples) { return swr_get_out_samples(swr, inputSamples); }
 
-            *outData = (uint8_t*)av_malloc(sizeof(uint8_t) * guessOutSize);
-            return guessOutSize;
+        /*
+         * Converts frame into the resampler's own buffer, see getData().
+         * @return samples per channel and bytes of output.
+         */
+        std::tuple<int, int> reSample(const AVFrame* frame) {
+            reserve(getMaxOutSamples(frame->nb_samples));
+            return convert(planes.data(), bufferSamples, frame);
         }
 
-        std::tuple<int, int> reSample(uint8_t* dataBuffer, int dataBufferSize,
-                                      const AVFrame* frame) {
-            int outSamples = swr_convert(swr, &dataBuffer, dataBufferSize,
-                                         (const uint8_t**)&frame->data[0], frame->nb_samples);
-            if (outSamples <= 0) {
-                throw std::runtime_error("error: outSamples=" + outSamples);
-            }
-
-            int outDataSize =
-                    av_samples_get_buffer_size(NULL, out.channels, outSamples, out.format, 1);
-
-            if (outDataSize <= 0) {
-                throw std::runtime_error("error: outDataSize=" + outDataSize);
+        // output of the last reSample(frame), one pointer per plane, valid until the next call.
+        uint8_t* const* getData() const { return planes.data(); }
+
+        /*
+         * Converts frame into pcm, which keeps its buffers unless they are too small; pcm->nb_samples
+         * becomes the output sample count.
+         * @return samples per channel and bytes of output.
+         */
+        std::tuple<int, int> reSample(AVFrame* pcm, const AVFrame* frame) {
+            int need = getMaxOutSamples(frame->nb_samples);
+            int bytesPerSample = (int)sizeof(Sample) * (PLANAR ? 1 : out.channels);
+            int capacity = pcm->buf[0] != nullptr ? pcm->linesize[0] / bytesPerSample : 0;
+            if (capacity < need) {
+                av_frame_unref(pcm);
+                pcm->format = OutFormat;
+                pcm->channel_layout = out.layout;
+                pcm->channels = out.channels;
+                pcm->sample_rate = out.sampleRate;
+                pcm->nb_samples = need;
+                if (av_frame_get_buffer(pcm, 0) < 0) {
+                    throw std::runtime_error("can not allocate audio frame.");
+                }
+                capacity = pcm->linesize[0] / bytesPerSample;
             }
-
-            return {outSamples, outDataSize};
+            auto result = convert(pcm->extended_data, capacity, frame);
+            pcm->nb_samples = std::get<0>(result);
+            return result;
         }
     };
 
+    // interleaved 16 bit, what the audio device is opened with.
+    using ReSampler = BasicReSampler<AV_SAMPLE_FMT_S16>;
+
+    using FloatPlanarReSampler = BasicReSampler<AV_SAMPLE_FMT_FLTP>;
+
 }  // namespace ffmpegUtil
@@ -0,0 +1,43 @@
+//
+// Headless decode benchmark entry point of the player: the whole file through DecodeBenchmark,
+// video converted exactly as playback would. Optionally writes the results as JSON for
+// regression tracking.
+//
+
+#include <iostream>
+#include <fstream>
+#include "DecodeBenchmark.h"
+#include "FrameRenderer.h"
+#include "Logger.h"
+
+using namespace std;
+using namespace ffmpegUtil;
+
+/*
+ * Decodes inputPath headless from start to end and prints the results; with a jsonPath they are
+ * also written there as one JSON object.
+ * @return 0 on success.
+ */
+int benchmark(const string& inputPath, const string& jsonPath) {
+    cout << "benchmark: " << inputPath << endl;
+    DecodeBenchmarkResult result;
+    try {
+        result = DecodeBenchmark::run(inputPath, FrameRenderer::candidateFormats());
+    } catch (std::runtime_error& e) {
+        cout << "benchmark failed: " << e.what() << endl;
+        return 1;
+    }
+    Logger::instance().flush();
+    result.print(cout);
+
+    if (!jsonPath.empty()) {
+        std::ofstream os{jsonPath, std::ios::trunc};
+        os << result.toJson(inputPath) << endl;
+        if (!os) {
+            cout << "can not write benchmark results: " << jsonPath << endl;
+            return 1;
+        }
+        cout << "benchmark results written to " << jsonPath << endl;
+    }
+    return 0;
+}
@@ -2,7 +2,11 @@
 // Created by 陈志帅 on 2020/4/15.
 //
 
+#include <cstdlib>
+#include <iostream>
 #include <string>
+#include "Instrumentation.h"
+#include "Logger.h"
 using namespace std;
 
 
@@ -10,14 +14,51 @@ extern void playAudio(const string& inputPath);
 
 extern void playVideo(const string& inputPath);
 
-extern void play(const string& inputPath);
+extern void play(const string& inputPath, double rate);
 
-int main() {
+extern int benchmark(const string& inputPath, const string& jsonPath);
+
+// usage: player [--bench] [--json <results file>] [--trace <trace file>] [--speed <0.5..4>] [media file]
+int main(int argc, char* argv[]) {
 
     string inputPath = "/Users/chenzhishuai/Downloads/baidunetdiskdownload/不能说的秘密.BD1280超清国语中字.mp4";
-    play(inputPath);
-//    playVideo(inputPath);
-    return 0;
+    bool bench = false;
+    string jsonPath;
+    string tracePath;
+    double speed = 1.0;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--bench") {
+            bench = true;
+        } else if (arg == "--json" && i + 1 < argc) {
+            bench = true;
+            jsonPath = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (arg == "--speed" && i + 1 < argc) {
+            speed = std::atof(argv[++i]);
+        } else {
+            inputPath = arg;
+        }
+    }
+    auto& instrumentation = ffmpegUtil::Instrumentation::instance();
+    instrumentation.nameThread("main");
+    if (!tracePath.empty()) {
+        instrumentation.enableTrace();
+    }
+    int ret = 0;
+    if (bench) {
+        ret = benchmark(inputPath, jsonPath);
+    } else {
+        play(inputPath, speed > 0 ? speed : 1.0);
+//        playVideo(inputPath);
+    }
+    ffmpegUtil::Logger::instance().flush();
+    instrumentation.printSummary(cout);
+    if (!tracePath.empty() && !instrumentation.writeChromeTrace(tracePath)) {
+        ret = ret == 0 ? 1 : ret;
+    }
+    return ret;
 };
 
 
@@ -4,10 +4,18 @@
 
 #include "ffmpegUtil.h"
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <mutex>
 #include <chrono>
+#include <ctime>
+#include <map>
 #include <thread>
 #include "MediaProcessor.hpp"
+#include "FrameRenderer.h"
+#include "Logger.h"
 
 extern "C"{
 #include "SDL2/SDL.h"
@@ -23,23 +31,108 @@ namespace {
     using namespace ffmpegUtil;
 
     void callback(void* userData, Uint8* stream, int len) {
+        static thread_local bool named = false;
+        if (!named) {
+            Instrumentation::instance().nameThread("sdl-audio");
+            named = true;
+        }
+        StageTimer timer{Instrumentation::AUDIO_CALLBACK};
         AudioProcessor* receiver = (AudioProcessor*)userData;
         receiver->writeAudioData(stream, len);
     }
 
-    void readPkt(PacketGrabber& packetGrabber, AudioProcessor* audioProcessor, VideoProcessor* videoProcessor){
-        const int CHECK_PERIOD = 10;
+    // seeks and track switches asked for by the ui thread, carried out by the reader thread.
+    class PlaybackRequests {
+        PacketDemand& packetDemand;
+        std::mutex requestMutex{};
+        std::atomic<bool> pending{false};
+        int64_t targetMs = 0;
+        std::chrono::steady_clock::time_point requestTime{};
+        std::atomic<bool> nextAudioTrack{false};
+
+    public:
+        explicit PlaybackRequests(PacketDemand& demand) : packetDemand(demand) {}
+
+        void requestSeek(int64_t ms) {
+            {
+                std::lock_guard<std::mutex> lg(requestMutex);
+                targetMs = std::max<int64_t>(0, ms);
+                requestTime = std::chrono::steady_clock::now();
+                pending.store(true);
+            }
+            packetDemand.notify();
+        }
+
+        void requestNextAudioTrack() {
+            nextAudioTrack.store(true);
+            packetDemand.notify();
+        }
 
-        cout << "read pkt thread started." << endl;
-        int audioIndex = audioProcessor->getAudioIndex();
-        int videoIndex = videoProcessor->getVideoIndex();
+        bool isPending() const { return pending.load() || nextAudioTrack.load(); }
 
-        while (!packetGrabber.isFileEnd() && !audioProcessor->isClosed() && !videoProcessor->isClosed()) {
-            while (audioProcessor->needPacket() || videoProcessor->needPacket()) {
-                AVPacket* packet = (AVPacket*)av_malloc(sizeof(AVPacket));
+        bool takeNextAudioTrack() { return nextAudioTrack.exchange(false); }
+
+        bool takeSeek(int64_t& ms, std::chrono::steady_clock::time_point& time) {
+            std::lock_guard<std::mutex> lg(requestMutex);
+            if (!pending.load()) {
+                return false;
+            }
+            pending.store(false);
+            ms = targetMs;
+            time = requestTime;
+            return true;
+        }
+    };
+
+    void readPkt(PacketGrabber& packetGrabber, PacketPool& packetPool, PacketDemand& packetDemand,
+                 PlaybackRequests& requests, AudioProcessor* audioProcessor, VideoProcessor* videoProcessor){
+        LOG_INFO("read pkt thread started.");
+        Instrumentation::instance().nameThread("reader");
+        auto audioStreams = packetGrabber.getAudioStreams();
+
+        // stays alive after the end of file, a seek can bring it back.
+        while (!audioProcessor->isClosing() && !videoProcessor->isClosing()) {
+            int64_t targetMs;
+            std::chrono::steady_clock::time_point requestTime;
+            if (requests.takeNextAudioTrack()) {
+                auto current = std::find(audioStreams.begin(), audioStreams.end(), packetGrabber.getAudioIndex());
+                auto next = current == audioStreams.end() || current + 1 == audioStreams.end()
+                            ? audioStreams.begin() : current + 1;
+                if (next != current && current != audioStreams.end()) {
+                    try {
+                        audioProcessor->switchStream(packetGrabber.getFormatCtx(), *next);
+                        packetGrabber.selectAudioStream(*next);
+                        if (packetGrabber.isFileEnd()) {
+                            // the new decoder gets no more packets, let it drain.
+                            audioProcessor->pushPkt(nullptr);
+                        }
+                    } catch (std::runtime_error& e) {
+                        LOG_ERROR("can not switch to audio stream " << *next << ": " << e.what());
+                    }
+                }
+                continue;
+            }
+            if (requests.takeSeek(targetMs, requestTime)) {
+                packetGrabber.seek(targetMs);
+                // flush even if the seek failed, the decoders are already discarding.
+                audioProcessor->seekFlush(targetMs, requestTime);
+                videoProcessor->seekFlush(targetMs, requestTime);
+                if (packetGrabber.isFileEnd()) {
+                    // a failed seek at the end of the file, the flushed decoders drain again.
+                    audioProcessor->pushPkt(nullptr);
+                    videoProcessor->pushPkt(nullptr);
+                }
+                continue;
+            }
+            while (!packetGrabber.isFileEnd() && !requests.isPending() &&
+                   (audioProcessor->needPacket() || videoProcessor->needPacket())) {
+                AVPacket* packet = packetPool.acquire();
                 int t = packetGrabber.grabPacket(packet);
+                int audioIndex = packetGrabber.getAudioIndex();
+                int videoIndex = packetGrabber.getVideoIndex();
                 if (t == -1) {
-                    cout << "file finish." << endl;
+                    LOG_INFO("file finish.");
+                    packetPool.recycle(packet);
                     audioProcessor->pushPkt(nullptr);
                     videoProcessor->pushPkt(nullptr);
                     break;
@@ -50,35 +143,87 @@ namespace {
                     unique_ptr<AVPacket> uPacket(packet);
                     videoProcessor->pushPkt(std::move(uPacket));
                 } else {
-                    av_packet_free(&packet);
-                    cout << "unknown streamIndex:" << t << endl;
+                    packetPool.recycle(packet);
+                    LOG_WARN("unknown streamIndex:" << t);
                 }
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(CHECK_PERIOD));
+            // sleep until a decoder drains its queue below the low-water mark, or a seek comes in.
+            packetDemand.wait([&] {
+                return (!packetGrabber.isFileEnd() && (audioProcessor->needPacket() || videoProcessor->needPacket())) ||
+                       requests.isPending() || audioProcessor->isClosing() || videoProcessor->isClosing();
+            });
         }
-        cout << "read pkt thread finished." << endl;
+        LOG_INFO("read pkt thread finished. wakeUps=" << packetDemand.getWakeUps()
+                 << ", audio starvation=" << audioProcessor->getStarvationCount()
+                 << ", video starvation=" << videoProcessor->getStarvationCount()
+                 << ", io stall=" << packetGrabber.getIoStallMs() << "ms"
+                 << ", packets=" << packetPool.getAcquisitions()
+                 << ", packet allocations=" << packetPool.getAllocations());
+    }
+
+    void printDecodeActivity(const string& name, const MediaProcessor& processor) {
+        LOG_INFO(name << " decode: runs=" << processor.getDecodeStats().runs.load()
+                 << " empty runs=" << processor.getEmptyRuns()
+                 << " packet wakeUps=" << processor.getPacketWakeUps()
+                 << " slot wakeUps=" << processor.getSlotWakeUps()
+                 << " busy=" << processor.getDecodeStats().getBusyMs() << "ms"
+                 << " idle=" << processor.getDecodeIdleRatio() * 100 << "%");
     }
 
-    void refreshPicture(int time, bool& exit, bool& faster){
-        cout << "refreshPic time:" << time << endl;
+    // playback rates stepped through with the [ and ] keys.
+    const double PLAYBACK_RATES[] = {0.5, 0.75, 1.0, 1.25, 1.5, 2.0, 3.0, 4.0};
+
+    // process cpu time (all threads) per second of media presented, for each playback rate used.
+    class RateCpuStats {
+        std::map<double, std::pair<int64_t, int64_t>> byRate{};  // rate -> cpu ns, media us
+        int64_t lastCpuNanos = processCpuNanos();
+
+        static int64_t processCpuNanos() {
+            timespec ts{};
+            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+            return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+        }
+
+    public:
+        // a frame covering mediaUs of the stream was presented at rate.
+        void onPresented(double rate, int64_t mediaUs) {
+            int64_t cpu = processCpuNanos();
+            auto& entry = byRate[rate];
+            entry.first += cpu - lastCpuNanos;
+            entry.second += mediaUs;
+            lastCpuNanos = cpu;
+        }
+
+        void print() const {
+            for (const auto& e : byRate) {
+                if (e.second.second <= 0) {
+                    continue;
+                }
+                LOG_INFO("rate " << e.first << "x: cpu = " << e.second.first / 1e3 / (e.second.second / 1e6)
+                         << "ms per media second over " << e.second.second / 1e6 << "s of media");
+            }
+        }
+    };
+
+    // pushes a REFRESH_EVENT once the steady clock reaches dueNs, the ui thread sets the next due time.
+    void refreshPicture(std::atomic<int64_t>& dueNs, std::atomic<bool>& exit){
+        const int64_t maxSleepNs = 2000000;  // picks up a due time moved closer in time
         while (!exit){
-            SDL_Event event;
-            event.type = REFRESH_EVENT;
-            SDL_PushEvent(&event);
-            if(faster){
-                std::this_thread::sleep_for(std::chrono::milliseconds(time / 2)) ;
-            }else{
-                std::this_thread::sleep_for(std::chrono::milliseconds(time));
+            int64_t due = dueNs.load();
+            int64_t now = steadyNanos();
+            if (due > now) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(std::min(due - now, maxSleepNs)));
+            } else if (dueNs.compare_exchange_strong(due, INT64_MAX)) {
+                SDL_Event event;
+                event.type = REFRESH_EVENT;
+                SDL_PushEvent(&event);
             }
         }
-        cout << "refreshPicture thread finish" << endl;
+        LOG_INFO("refreshPicture thread finish");
     }
 
-    void videoPlay (VideoProcessor& videoProcessor, AudioProcessor* audio = nullptr) {
-
-        auto width = videoProcessor.getWidth();
-        auto height = videoProcessor.getHeight();
-
+    // a window of width x height and its renderer, call after SDL_Init.
+    SDL_Renderer* createRenderer(int width, int height) {
         SDL_Window* window;
 
         window = SDL_CreateWindow("player", SDL_WINDOWPOS_UNDEFINED,SDL_WINDOWPOS_UNDEFINED, width, height,
@@ -86,78 +231,136 @@ namespace {
         if (!window) {
             string errMsg = "could not create window";
             errMsg += SDL_GetError();
-            cout << errMsg << endl;
+            LOG_ERROR(errMsg);
             throw std::runtime_error(errMsg);
         }
 
-        SDL_Renderer* sdlRenderer = SDL_CreateRenderer(window, -1, 0);
-
-        Uint32 pixFormat = SDL_PIXELFORMAT_IYUV;
+        return SDL_CreateRenderer(window, -1, 0);
+    }
 
-        SDL_Texture* sdlTexture = SDL_CreateTexture(sdlRenderer, pixFormat, SDL_TEXTUREACCESS_STREAMING, width, height);
+    void videoPlay (VideoProcessor& videoProcessor, FrameRenderer& frameRenderer,
+                    std::chrono::steady_clock::time_point openTime, PlaybackRequests& requests,
+                    AudioProcessor* audio = nullptr, double rate = 1.0) {
 
         SDL_Event event;
         auto frameRate = videoProcessor.getFrameRate();
-        cout << "frame rate " << frameRate <<  endl;
-
-        bool exit = false;
-        bool faster = false;
-        std::thread refreshThread{refreshPicture, (int)(1000 / frameRate), std::ref(exit), std::ref(faster)};
+        LOG_INFO("frame rate " << frameRate);
+
+        // frames are paced by the audio clock when there is audio, by their durations otherwise.
+        // delays are worked out in stream time and divided by the playback rate.
+        int64_t defaultDurationUs = frameRate > 0 ? (int64_t)(1000000 / frameRate) : 40000;
+        AvSync avSync;
+        RateCpuStats rateCpu;
+        int64_t lastPtsUs = -1;
+        auto setRate = [&](double r) {
+            rate = r;
+            videoProcessor.setPlaybackRate(r);
+            if (audio != nullptr) {
+                audio->setPlaybackRate(r);
+            }
+            LOG_INFO("playback rate " << r << "x");
+        };
+        std::atomic<bool> exit{false};
+        std::atomic<int64_t> dueNs{steadyNanos()};
+        std::thread refreshThread{refreshPicture, std::ref(dueNs), std::ref(exit)};
 
         int failCount = 0;
-        int fastCount = 0;
-        int slowCount = 0;
-        while (!videoProcessor.isStreamFinished()) {
+        bool firstFrameShown = false;
+        // frames still queued when the decoder finished are shown before leaving.
+        while (!videoProcessor.isDrained()) {
             SDL_WaitEvent(&event);
 
             if (event.type == REFRESH_EVENT) {
-                if (videoProcessor.isStreamFinished()) {
+                if (videoProcessor.isDrained()) {
                     exit = true;
                     continue;
                 }
 
-                if (audio != nullptr) {
-                    auto vTs = videoProcessor.getPts();
-                    auto aTs = audio->getPts();
-                    if (vTs > aTs && vTs - aTs > 30) {
-                        cout << "VIDEO FASTER ================= vTs - aTs [" << (vTs - aTs)
-                             << "]ms, SKIP A EVENT" << endl;
-                        faster = false;
-                        slowCount++;
-                        continue;
-                    } else if (vTs < aTs && aTs - vTs > 30) {
-                        cout << "VIDEO SLOWER ================= aTs - vTs =[" << (aTs - vTs) << "]ms, Faster" << endl;
-                        faster = true;
-                        fastCount++;
-                    } else {
-                        faster = false;
-                    }
-                }
-
                 AVFrame* frame = videoProcessor.getFrame();
+                int64_t durationUs = videoProcessor.getFrameDurationUs() > 0 ? videoProcessor.getFrameDurationUs()
+                                                                              : defaultDurationUs;
+                int64_t delayUs = durationUs;
 
                 if (frame != nullptr) {
-                    SDL_UpdateYUVTexture(sdlTexture,NULL,
-
-                            frame->data[0], frame->linesize[0],
+                    frameRenderer.render(frame);
 
-                            frame->data[1], frame->linesize[1],
-
-                            frame->data[2],frame->linesize[2]);
+                    // frames skipped at decode time leave gaps, the last one is the best guess of the next.
+                    int64_t ptsUs = videoProcessor.getFramePtsUs();
+                    if (lastPtsUs >= 0 && ptsUs > lastPtsUs && ptsUs - lastPtsUs <= 8 * durationUs) {
+                        durationUs = ptsUs - lastPtsUs;
+                    }
+                    lastPtsUs = ptsUs;
+                    delayUs = durationUs;
+                    rateCpu.onPresented(rate, durationUs);
+
+                    if (!firstFrameShown) {
+                        firstFrameShown = true;
+                        std::chrono::duration<double, std::milli> ttff = std::chrono::steady_clock::now() - openTime;
+                        LOG_INFO("time to first frame: " << ttff.count() << "ms");
+                    }
 
-                    SDL_RenderClear(sdlRenderer);
-                    SDL_RenderCopy(sdlRenderer, sdlTexture, NULL, NULL);
-                    SDL_RenderPresent(sdlRenderer);
+                    int64_t audioUs = audio != nullptr ? audio->getClockUs() : -1;
+                    if (audioUs >= 0) {
+                        int64_t offsetUs = ptsUs - audioUs;
+                        videoProcessor.reportLateness(-offsetUs / 1000, audioUs / 1000);
+                        delayUs = avSync.onPresented(offsetUs, durationUs);
+                    }
 
                     if (!videoProcessor.refreshFrame()) {
-                        cout << "vProcessor.refreshFrame false" << endl;
+                        LOG_INFO("vProcessor.refreshFrame false");
                     }
                 } else {
                     failCount++;
-                    cout << "getFrame fail. failCount = " << failCount << endl;
+                    delayUs = durationUs / 4;
+                    LOG_WARN("getFrame fail. failCount = " << failCount);
+                }
+                dueNs.store(steadyNanos() + (int64_t)(delayUs * 1000 / rate));
+            } else if (event.type == SDL_KEYDOWN) {
+                // left/right seek 10s, down/up seek 60s, a switches to the next audio track,
+                // [ and ] step the playback rate down and up, backslash resets it.
+                if (event.key.keysym.sym == SDLK_a && audio != nullptr) {
+                    requests.requestNextAudioTrack();
+                    continue;
+                }
+                if (event.key.keysym.sym == SDLK_LEFTBRACKET || event.key.keysym.sym == SDLK_RIGHTBRACKET ||
+                    event.key.keysym.sym == SDLK_BACKSLASH) {
+                    double next = 1.0;
+                    if (event.key.keysym.sym == SDLK_LEFTBRACKET) {
+                        next = PLAYBACK_RATES[0];
+                        for (double r : PLAYBACK_RATES) {
+                            if (r < rate) {
+                                next = r;
+                            }
+                        }
+                    } else if (event.key.keysym.sym == SDLK_RIGHTBRACKET) {
+                        next = std::end(PLAYBACK_RATES)[-1];
+                        for (auto r = std::rbegin(PLAYBACK_RATES); r != std::rend(PLAYBACK_RATES); r++) {
+                            if (*r > rate) {
+                                next = *r;
+                            }
+                        }
+                    }
+                    if (next != rate) {
+                        setRate(next);
+                    }
+                    continue;
+                }
+                int64_t step = 0;
+                switch (event.key.keysym.sym) {
+                    case SDLK_LEFT: step = -10000; break;
+                    case SDLK_RIGHT: step = 10000; break;
+                    case SDLK_DOWN: step = -60000; break;
+                    case SDLK_UP: step = 60000; break;
+                    default: break;
+                }
+                if (step != 0) {
+                    auto pts = audio != nullptr && audio->getClockUs() >= 0 ? audio->getClockUs() / 1000
+                                                                            : (int64_t)videoProcessor.getPts();
+                    LOG_INFO("seek request: " << pts << "ms -> " << pts + step << "ms");
+                    requests.requestSeek(pts + step);
                 }
             } else if (event.type == SDL_QUIT) {
-                cout << "SDL screen got a SDL_QUIT." << endl;
+                LOG_INFO("SDL screen got a SDL_QUIT.");
                 exit = true;
                 break;
             } else if (event.type == BREAK_EVENT) {
@@ -165,28 +368,56 @@ namespace {
             }
         }
 
+        exit = true;
         refreshThread.join();
-        cout << "Sdl video thread finish: failCount = " << failCount << ", fastCount = " << fastCount
-             << ", slowCount = " << slowCount << endl;
+        rateCpu.print();
+        LOG_INFO("Sdl video thread finish: failCount = " << failCount << ", last seek latency = "
+                 << videoProcessor.getLastSeekLatencyMs() << "ms, frame queue avg = "
+                 << videoProcessor.getAverageQueuedFrames() << "/" << videoProcessor.getFrameQueueSize()
+                 << ", quality escalations = " << videoProcessor.getQualityController().getEscalations()
+                 << ", recoveries = " << videoProcessor.getQualityController().getRecoveries()
+                 << ", dropped late frames = " << videoProcessor.getDroppedFrames());
+        LOG_INFO("frames passed through = " << videoProcessor.getPassedFrames()
+                 << ", converted = " << videoProcessor.getConvertedFrames()
+                 << ", bytes copied per frame: convert = " << videoProcessor.getConvertBytesPerFrame()
+                 << ", texture upload = " << frameRenderer.getUploadBytesPerFrame());
+        if (videoProcessor.getConvertedFrames() > 0) {
+            const auto& converter = videoProcessor.getConverter();
+            LOG_INFO("convert ms per frame = " << converter.getMsPerFrame() << " (slices = "
+                     << converter.getSliceCount() << ", cores = " << converter.getMaxSlices() << ")");
+        }
+        if (avSync.getSamples() > 0) {
+            LOG_INFO("a/v offset: frames = " << avSync.getSamples() << ", within one frame = "
+                     << avSync.getWithinFrameRatio() * 100 << "%");
+            const char* names[] = {"video ahead", "video behind"};
+            const LatencyHistogram* offsets[] = {&avSync.getAhead(), &avSync.getBehind()};
+            for (int i = 0; i < 2; i++) {
+                LOG_INFO("  " << names[i] << " (ms): n = " << offsets[i]->getCount()
+                         << " p50 = " << offsets[i]->getPercentileNanos(50) / 1e6
+                         << " p90 = " << offsets[i]->getPercentileNanos(90) / 1e6
+                         << " p99 = " << offsets[i]->getPercentileNanos(99) / 1e6
+                         << " max = " << offsets[i]->getMaxNanos() / 1e6);
+            }
+        }
     }
 
     void audioPlay(SDL_AudioDeviceID& audioDeviceId, AudioProcessor& audioProcessor){
         SDL_AudioSpec spec;
         SDL_AudioSpec wantedSpec;
 
-        cout << "audioProcessor.getSampleFormat()" << audioProcessor.getSampleFormat() << endl;
-        cout << "audioProcessor.getOutSampleRate()" << audioProcessor.getOutSampleRate() << endl;
-        cout << "audioProcessor.getOutChannels()" << audioProcessor.getOutChannels() << endl;
+        LOG_INFO("audioProcessor.getSampleFormat()" << audioProcessor.getSampleFormat());
+        LOG_INFO("audioProcessor.getOutSampleRate()" << audioProcessor.getOutSampleRate());
+        LOG_INFO("audioProcessor.getOutChannels()" << audioProcessor.getOutChannels());
 
         int samples = -1;
 
         while (true) {
-            cout << "get audio samples" << endl;
+            LOG_INFO("get audio samples");
             samples = audioProcessor.getSamples();
             if(samples <= 0){
                 std::this_thread::sleep_for(std::chrono::milliseconds(10));
             } else{
-                cout << "get audio samples" << samples << endl;
+                LOG_INFO("get audio samples" << samples);
                 break;
             }
         }
@@ -203,80 +434,115 @@ namespace {
         if (audioDeviceId == 0) {
             string errMsg = "Failed to open audio device:";
             errMsg += SDL_GetError();
-            cout << errMsg << endl;
+            LOG_ERROR(errMsg);
             throw std::runtime_error(errMsg);
         }
 
-        cout << "wantedSpec.freq:" << wantedSpec.freq << endl;
+        LOG_INFO("wantedSpec.freq:" << wantedSpec.freq);
         std::printf("wantedSpec.format: Ox%X\n", wantedSpec.format);
-        cout << "wantedSpec.channels:" << wantedSpec.channels << endl;
-        cout << "wantedSpec.samples:" << wantedSpec.samples << endl;
+        LOG_INFO("wantedSpec.channels:" << wantedSpec.channels);
+        LOG_INFO("wantedSpec.samples:" << wantedSpec.samples);
 
-        cout << "spec.freq:" << spec.freq << endl;
+        LOG_INFO("spec.freq:" << spec.freq);
         std::printf("spec.format: Ox%X\n", spec.format);
-        cout << "spec.channels:" << spec.channels << endl;
-        cout << "spec.silence:" << spec.silence << endl;
-        cout << "spec.samples:" << spec.samples << endl;
+        LOG_INFO("spec.channels:" << spec.channels);
+        LOG_INFO("spec.silence:" << spec.silence);
+        LOG_INFO("spec.samples:" << spec.samples);
+        audioProcessor.setDeviceLatencyUs((int64_t)spec.samples * 1000000 / spec.freq);
 
         SDL_PauseAudioDevice(audioDeviceId, 0);
-        cout << "audio start thread finish." << endl;
+        LOG_INFO("audio start thread finish.");
     }
 
 
-    int playVideoAndAudio(const string& inputPath){
+    int playVideoAndAudio(const string& inputPath, double rate){
 
-        PacketGrabber packetGrabber{inputPath};
+        auto openTime = std::chrono::steady_clock::now();
+        // local files are read ahead on the prefetch io thread, the reader only waits (io stall) when
+        // it outruns it.
+        InputOptions inputOptions{InputOptions::PREFETCH_IO};
+        inputOptions.fastProbe = true;
+        PacketGrabber packetGrabber{inputPath, inputOptions};
         auto formatCtx = packetGrabber.getFormatCtx();
         av_dump_format(formatCtx, 0, "", 0);
 
-        VideoProcessor videoProcessor(formatCtx);
-        videoProcessor.start();
-
-        AudioProcessor audioProcessor(formatCtx);
-        audioProcessor.start();
+        // a keyframe index saved by an earlier run makes seeks land on the right keyframe at once.
+        bool keyframeIndexLoaded = packetGrabber.getKeyframeIndex().load(inputPath);
 
-        std::thread readerThread{readPkt, std::ref(packetGrabber), &audioProcessor,
-                                 &videoProcessor};
+        PacketPool packetPool;
+        PacketDemand packetDemand;
+        PlaybackRequests requests{packetDemand};
 
         SDL_setenv("SDL_AUDIO_ALSA_SET_BUFFER_SIZE", "1", 1);
 
         if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER)) {
             string errMsg = "Could not initialize SDL -";
             errMsg += SDL_GetError();
-            cout << errMsg << endl;
+            LOG_ERROR(errMsg);
             throw std::runtime_error(errMsg);
         }
 
+        VideoProcessor videoProcessor(formatCtx, packetGrabber.getVideoIndex());
+        videoProcessor.setPacketDemand(&packetDemand);
+        videoProcessor.setPacketPool(&packetPool);
+
+        // the renderer exists before decoding starts, frames are converted only to what it takes.
+        FrameRenderer frameRenderer{createRenderer(videoProcessor.getWidth(), videoProcessor.getHeight())};
+        videoProcessor.setOutputFormats(frameRenderer.getDisplayFormats());
+        videoProcessor.setPlaybackRate(rate);
+        videoProcessor.start();
+
+        AudioProcessor audioProcessor(formatCtx, packetGrabber.getAudioIndex());
+        audioProcessor.setPacketDemand(&packetDemand);
+        audioProcessor.setPacketPool(&packetPool);
+        audioProcessor.setPlaybackRate(rate);
+        audioProcessor.start();
+        audioProcessor.startPcmFeed();
+
+        std::thread readerThread{readPkt, std::ref(packetGrabber), std::ref(packetPool),
+                                 std::ref(packetDemand), std::ref(requests), &audioProcessor, &videoProcessor};
+
         SDL_AudioDeviceID audioDeviceId;
 
         std::thread startAudioThread(audioPlay, std::ref(audioDeviceId),std::ref(audioProcessor));
         startAudioThread.join();
 
-        videoPlay(videoProcessor, &audioProcessor);
+        videoPlay(videoProcessor, frameRenderer, openTime, requests, &audioProcessor, rate);
 
-        cout << "videoThread join." << endl;
+        LOG_INFO("videoThread join.");
 
         SDL_PauseAudioDevice(audioDeviceId, 1);
         SDL_CloseAudio();
 
+        printDecodeActivity("audio", audioProcessor);
+        printDecodeActivity("video", videoProcessor);
+        LOG_INFO("audio frame queue avg = " << audioProcessor.getAverageQueuedFrames() << "/"
+                 << audioProcessor.getFrameQueueSize());
+        LOG_INFO("audio underruns = " << audioProcessor.getUnderruns() << " (" << audioProcessor.getUnderrunMs()
+                 << "ms of silence), pcm fifo = " << audioProcessor.getPcmFilledMs() << "/"
+                 << audioProcessor.getPcmFifoMs() << "ms");
+
         bool r;
         r = audioProcessor.close();
-        cout << "audioProcessor closed: " << r << endl;
+        LOG_INFO("audioProcessor closed: " << r);
         r = videoProcessor.close();
-        cout << "videoProcessor closed: " << r << endl;
-
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        LOG_INFO("videoProcessor closed: " << r);
 
         readerThread.join();
-        cout << "Pause and Close audio" << endl;
+        LOG_INFO("Pause and Close audio");
+
+        if (!keyframeIndexLoaded && packetGrabber.getKeyframeIndex().save(inputPath)) {
+            LOG_INFO("keyframe index saved for: " << inputPath);
+        }
 
         return 0;
     }
 }
 
 
-void play(const string& inputPath){
-    cout << "input path:" << inputPath << endl;
-    playVideoAndAudio(inputPath);
+// rate: initial playback rate, 0.5 to 4.
+void play(const string& inputPath, double rate){
+    LOG_INFO("input path:" << inputPath);
+    playVideoAndAudio(inputPath, std::max(PLAYBACK_RATES[0], std::min(rate, std::end(PLAYBACK_RATES)[-1])));
 }
 
@@ -3,9 +3,14 @@
 //
 
 
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <thread>
 #include "ffmpegUtil.h"
 #include "FrameGrabber.h"
+#include "Instrumentation.h"
+#include "PcmFifo.h"
 
 extern "C" {
 #include "SDL2/SDL.h"
@@ -18,42 +23,59 @@ using std::string;
 namespace {
     using namespace ffmpegUtil;
 
+    /*
+     * The decode thread reads, decodes and resamples ahead into the fifo; the device callback only
+     * copies out of it, so file I/O and decoding never run on the real-time audio thread.
+     */
     struct PlayUtil {
+        static constexpr int FIFO_MS = 200;
+        static constexpr int FEED_INTERVAL_MS = 5;
+
         FrameGrabber* grabber;
-        ReSampler* reSmapler;
+        ReSampler* reSampler;
+        PcmFifo fifo;
+        std::atomic<bool> decodeFinished{false};
+        std::atomic<bool> stopping{false};
+        LatencyHistogram callbackNanos{};  // written by the callback only
+
+        PlayUtil(FrameGrabber* g, ReSampler* r, int bytesPerSecond)
+                : grabber(g), reSampler(r), fifo((size_t)bytesPerSecond * FIFO_MS / 1000) {}
     };
 
-    void audio_callback(void* userdata, Uint8* stream, int len) {
-        PlayUtil* playUtil = (PlayUtil*)userdata;
-        FrameGrabber* grabber = playUtil->grabber;
-        ReSampler* reSampler = playUtil->reSmapler;
-
-        static uint8_t* outBuffer = nullptr;
-        static int outBufferSize = 0;
-        static AVFrame* aFrame = av_frame_alloc();
-
-
-
-        int ret = grabber->grabAudioFrame(aFrame);
-        if (ret == 2) {
-            // cout << "play with ReSampler!" << endl;
-            if (outBuffer == nullptr) {
-                outBufferSize = reSampler->allocDataBuf(&outBuffer, aFrame->nb_samples);
-                cout << " --------- audio samples: " << aFrame->nb_samples << endl;
-            } else {
-                memset(outBuffer, 0, outBufferSize);
-            }
-
-            int outSamples;
-            int outDataSize;
-            std::tie(outSamples, outDataSize) = reSampler->reSample(outBuffer, outBufferSize, aFrame);
-
-            if (outDataSize != len) {
-                cout << "WARNING: outDataSize[" << outDataSize << "] != len[" << len << "]" << endl;
+    void decodeLoop(PlayUtil* playUtil) {
+        Instrumentation::instance().nameThread("decoder");
+        AVFrame* aFrame = av_frame_alloc();
+        const std::chrono::milliseconds interval{(int)PlayUtil::FEED_INTERVAL_MS};
+        try {
+            while (!playUtil->stopping && playUtil->grabber->grabAudioFrame(aFrame) == 2) {
+                int outDataSize = std::get<1>(playUtil->reSampler->reSample(aFrame));
+                const uint8_t* data = playUtil->reSampler->getData()[0];
+                int written = 0;
+                while (!playUtil->stopping) {
+                    written += (int)playUtil->fifo.write(data + written, outDataSize - written);
+                    if (written >= outDataSize) {
+                        break;
+                    }
+                    std::this_thread::sleep_for(interval);
+                }
             }
-
-            std::memcpy(stream, outBuffer, outDataSize);
+        } catch (std::runtime_error& e) {
+            cout << "audio decode error: " << e.what() << endl;
         }
+        av_frame_free(&aFrame);
+        playUtil->fifo.markEnd();
+        playUtil->decodeFinished = true;
+    }
+
+    // copies from the fifo, silence where it ran dry. never blocks, locks or allocates.
+    void audio_callback(void* userdata, Uint8* stream, int len) {
+        auto& instrumentation = Instrumentation::instance();
+        uint64_t begin = instrumentation.now();
+        PlayUtil* playUtil = (PlayUtil*)userdata;
+        playUtil->fifo.read(stream, len);
+        uint64_t end = instrumentation.now();
+        instrumentation.record(Instrumentation::AUDIO_CALLBACK, begin, end);
+        playUtil->callbackNanos.record(end - begin);
     }
 
     void playMediaFileAudio(const string& inputPath) {
@@ -71,7 +93,8 @@ namespace {
 
         ReSampler reSampler(inAudio, outAudio);
 
-        PlayUtil playUtil{&grabber, &reSampler};
+        PlayUtil playUtil{&grabber, &reSampler,
+                          outAudio.sampleRate * outAudio.channels * av_get_bytes_per_sample(outAudio.format)};
 
         SDL_setenv("SDL_AUDIO_ALSA_SET_BUFFER_SIZE", "1", 1);
 
@@ -95,7 +118,7 @@ namespace {
         // set audio settings from codec info
         wanted_specs.freq = grabber.getSampleRate();
         wanted_specs.format = AUDIO_S16SYS;
-        wanted_specs.channels = grabber.getChannels();
+        wanted_specs.channels = outAudio.channels;
         wanted_specs.samples = 1024; //set by output samples
         wanted_specs.callback = audio_callback;
         wanted_specs.userdata = &playUtil;
@@ -130,13 +153,32 @@ namespace {
         cout << "specs.silence:" << (int)specs.silence << endl;
         cout << "specs.samples:" << (int)specs.samples << endl;
 
+        // fill the fifo before the device starts pulling from it.
+        std::thread decodeThread{decodeLoop, &playUtil};
+        while (!playUtil.decodeFinished && playUtil.fifo.getFreeBytes() > 0) {
+            SDL_Delay(PlayUtil::FEED_INTERVAL_MS);
+        }
+
         cout << "waiting audio play..." << endl;
 
         SDL_PauseAudioDevice(audioDeviceID, 0);  // [2]
 
-        SDL_Delay(300000);
+        // plays until the stream is decoded and the device has taken all of it, then lets the
+        // last period drain.
+        while (!playUtil.decodeFinished || playUtil.fifo.getFilledBytes() > 0) {
+            SDL_Delay(10);
+        }
+        SDL_Delay(specs.samples * 1000 / specs.freq + 10);
+
+        SDL_PauseAudioDevice(audioDeviceID, 1);
+        SDL_CloseAudioDevice(audioDeviceID);
+        playUtil.stopping = true;
+        decodeThread.join();
 
-        SDL_CloseAudio();
+        const LatencyHistogram& callback = playUtil.callbackNanos;
+        cout << "audio callback (us): n = " << callback.getCount() << " p50 = " << callback.getPercentileNanos(50) / 1e3
+             << " p99 = " << callback.getPercentileNanos(99) / 1e3 << " max = " << callback.getMaxNanos() / 1e3
+             << ", underruns = " << playUtil.fifo.getUnderruns() << endl;
 
         //----------------------------------
     }
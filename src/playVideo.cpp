@@ -6,6 +6,8 @@
 #include <fstream>
 #include "ffmpegUtil.h"
 #include "FrameGrabber.h"
+#include "FrameRenderer.h"
+#include "SliceConverter.h"
 
 extern "C" {
 #include "SDL2/SDL.h"
@@ -77,12 +79,11 @@ namespace {
 
         SDL_Renderer* sdlRenderer = SDL_CreateRenderer(screen, -1, 0); //创建渲染器
 
-        // IYUV: Y + U + V  (3 planes)
-        // YV12: Y + V + U  (3 planes)
-        Uint32 pixformat = SDL_PIXELFORMAT_IYUV;
-
-        SDL_Texture* sdlTexture = //创建纹理
-                SDL_CreateTexture(sdlRenderer, pixformat, SDL_TEXTUREACCESS_STREAMING, w, h);
+        // frames in a format the renderer takes are shown as decoded, others are converted to its preferred one.
+        FrameRenderer frameRenderer{sdlRenderer};
+        bool passThrough = frameRenderer.isDisplayFormat(fmt);
+        const AVPixelFormat target = frameRenderer.getDisplayFormats().front();
+        cout << "pixel format " << av_get_pix_fmt_name(fmt) << (passThrough ? " shown as is" : " converted") << endl;
 
         //---------------------------------------------
 
@@ -108,21 +109,23 @@ namespace {
 
             SDL_Event event;
 
-            struct SwsContext* sws_ctx =
-                    sws_getContext(w, h, fmt, w, h, AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
-
-            int numBytes = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, w, h, 32);//返回存储字节所需的数据量的大小
-            uint8_t* buffer = (uint8_t*)av_malloc(numBytes * sizeof(uint8_t));
+            SliceConverter converter{};
             AVFrame* pict = av_frame_alloc();
-            av_image_fill_arrays(pict->data, pict->linesize, buffer, AV_PIX_FMT_YUV420P, w, h, 32);
+            if (!passThrough) {
+                pict->format = target;
+                pict->width = w;
+                pict->height = h;
+                av_frame_get_buffer(pict, 32);
+            }
+            AVFrame* shown = passThrough ? frame : pict;
 
             while (true) {
                 if (!videoFinish) {
                     ret = grabber.grabImageFrame(frame);
                     if (ret == 1) {  // success.
-                        sws_scale(sws_ctx, (uint8_t const* const*)frame->data, frame->linesize, 0, h,
-                                  pict->data, pict->linesize);
-
+                        if (!passThrough) {
+                            converter.convert(frame, pict);
+                        }
                     } else if (ret == 0) {  // no more frame.
                         cout << "VIDEO FINISHED." << endl;
                         videoFinish = true;
@@ -142,25 +145,7 @@ namespace {
                 // WAIT USER EVENT.
                 SDL_WaitEvent(&event);
                 if (event.type == REFRESH_EVENT) {
-                    // Use this function to update a rectangle within a planar
-                    // YV12 or IYUV texture with new pixel data.
-                    SDL_UpdateYUVTexture(sdlTexture,  // the texture to update 设置纹理YUV数据
-                                         NULL,        // a pointer to the rectangle of pixels to update, or
-                            // NULL to update the entire texture
-                                         pict->data[0],      // the raw pixel data for the Y plane
-                                         pict->linesize[0],  // the number of bytes between rows of pixel
-                            // data for the Y plane
-                                         pict->data[1],      // the raw pixel data for the U plane
-                                         pict->linesize[1],  // the number of bytes between rows of pixel
-                            // data for the U plane
-                                         pict->data[2],      // the raw pixel data for the V plane
-                                         pict->linesize[2]   // the number of bytes between rows of pixel
-                            // data for the V plane
-                    );
-
-                    SDL_RenderClear(sdlRenderer);
-                    SDL_RenderCopy(sdlRenderer, sdlTexture, NULL, NULL); //纹理给渲染器
-                    SDL_RenderPresent(sdlRenderer); //渲染出来
+                    frameRenderer.render(shown); //纹理给渲染器, 渲染出来
 
                 } else if (event.type == SDL_QUIT) {
                     thread_exit = 1;
@@ -168,7 +153,10 @@ namespace {
                     break;
                 }
             }
+            cout << "bytes copied per frame: convert = " << (passThrough ? 0 : av_image_get_buffer_size(target, w, h, 1))
+                 << ", texture upload = " << frameRenderer.getUploadBytesPerFrame() << endl;
             av_frame_free(&frame);
+            av_frame_free(&pict);
         } catch (std::exception ex) {
             cout << "Exception in play media file:" << ex.what() << endl;
         } catch (...) {